@@ -0,0 +1,46 @@
+// Copyright (c) 2024 Manuel Schneider
+
+#include "deliverybench.h"
+#include "usagehistorybench.h"
+#if defined(Q_OS_UNIX) && !defined(Q_OS_MAC)
+#include "iconbench.h"
+#endif
+#include <QApplication>
+#include <functional>
+#include <map>
+#include <memory>
+using namespace std;
+
+///
+/// Runs the benchmarks.
+///
+/// Usage: albert_bench [benchmark…] [QTest options]
+///
+/// Runs all benchmarks if none is given. Results are QTest benchmark results.
+/// Use e.g. '-o results.csv,csv' with a single benchmark to compare builds.
+///
+int main(int argc, char *argv[])
+{
+    QApplication app(argc, argv);
+
+    const map<QString, function<unique_ptr<QObject>()>> benchmarks{
+        {"delivery", []{ return make_unique<DeliveryBench>(); }},
+#if defined(Q_OS_UNIX) && !defined(Q_OS_MAC)
+        {"icons", []{ return make_unique<IconBench>(); }},
+#endif
+        {"usagehistory", []{ return make_unique<UsageHistoryBench>(); }},
+    };
+
+    QStringList selected;
+    QStringList args = app.arguments();
+    while (args.size() > 1 && benchmarks.contains(args[1]))
+        selected << args.takeAt(1);
+    if (selected.isEmpty())
+        for (const auto &[name, _] : benchmarks)
+            selected << name;
+
+    int status = 0;
+    for (const auto &name : selected)
+        status |= QTest::qExec(benchmarks.at(name)().get(), args);
+    return status;
+}
@@ -0,0 +1,18 @@
+// Copyright (c) 2024 Manuel Schneider
+
+#include "benchcounters.h"
+#include <QtTest/QtTest>
+
+BenchCounters::BenchCounters() { PerfCounters::threadInstance().start(); }
+
+BenchCounters::~BenchCounters()
+{ log(PerfCounters::threadInstance().stop(), iterations_, QStringLiteral("iteration")); }
+
+void BenchCounters::log(const PerfCounters::Sample &sample, uint64_t count, const QString &unit)
+{
+    if (const auto s = sample / count; s.valid)
+        qInfo().noquote() << QString("%1(%2) per %3: %4")
+                                 .arg(QString::fromLatin1(QTest::currentTestFunction()),
+                                      QString::fromLatin1(QTest::currentDataTag()),
+                                      unit, s.toString());
+}
@@ -0,0 +1,33 @@
+// Copyright (c) 2024 Manuel Schneider
+
+#pragma once
+#include "perfcounters.h"
+
+///
+/// Counts the hardware events of the calling thread in a benchmark slot.
+///
+/// QTest reports a single metric per benchmark, hence the counts are logged
+/// next to it when the counter goes out of scope, divided by the iterations
+/// of the benchmark body. Silent if the counters are unavailable.
+///
+class BenchCounters
+{
+public:
+
+    /// Starts counting.
+    BenchCounters();
+
+    /// Stops counting and logs the counts per iteration.
+    ~BenchCounters();
+
+    /// Counts an iteration of the benchmark body.
+    void iterate() { ++iterations_; }
+
+    /// Logs the counts of the current benchmark per unit, e.g. per row.
+    static void log(const PerfCounters::Sample &sample, uint64_t count, const QString &unit);
+
+private:
+
+    uint64_t iterations_ = 0;
+
+};
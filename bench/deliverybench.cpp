@@ -0,0 +1,256 @@
+// Copyright (c) 2024 Manuel Schneider
+
+#include "benchcounters.h"
+#include "deliverybench.h"
+#include "queryexecution.h"
+#include "queryexecutor.h"
+#include "standarditem.h"
+#include "triggerqueryhandler.h"
+#include <QAbstractItemModelTester>
+#include <QEventLoop>
+#include <QTimer>
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <optional>
+#include <thread>
+using namespace albert;
+using namespace std::chrono;
+using namespace std;
+
+static const int row_count = 10000;
+static const int timeout = 60000;  // ms
+static const int runs = 5;  // Per scenario, the metrics are their medians
+
+namespace
+{
+
+///
+/// Forwards to the default executor, accounting the tasks posted to the main thread.
+///
+class AccountingExecutor : public QueryExecutor
+{
+public:
+
+    AccountingExecutor() : base_(QueryExecutor::instance()) { QueryExecutor::setInstance(this); }
+    ~AccountingExecutor() { QueryExecutor::setInstance(nullptr); }
+
+    QueryLatency::TimePoint now() const override { return base_.now(); }
+    TaskId run(Task task, int priority) override { return base_.run(::move(task), priority); }
+    bool cancel(TaskId task) override { return base_.cancel(task); }
+    void wait(QFuture<void> &future) override { base_.wait(future); }
+
+    void post(QObject *context, Task task) override
+    {
+        ++posted;
+        base_.post(context, [this, t = ::move(task)]{
+            auto &counters = PerfCounters::threadInstance();
+            QElapsedTimer timer;
+            timer.start();
+            counters.start();
+            t();
+            main_thread_counters += counters.stop();
+            main_thread_ns += timer.nsecsElapsed();
+        });
+    }
+
+    atomic<uint> posted = 0;
+    // Written in the main thread only
+    qint64 main_thread_ns = 0;
+    PerfCounters::Sample main_thread_counters;
+
+private:
+
+    QueryExecutor &base_;
+
+};
+
+
+///
+/// Adds the items in batches, one batch per interval.
+///
+class BatchHandler : public TriggerQueryHandler
+{
+public:
+
+    BatchHandler(int batch, int interval_us) : batch_(batch), interval_(interval_us)
+    {
+        for (int i = 0; i < row_count; ++i)
+        {
+            auto s = QString("item %1").arg(i);
+            items_.emplace_back(make_shared<StandardItem>(s, s));
+        }
+    }
+
+    QString id() const override { return QStringLiteral("batch"); }
+    QString name() const override { return id(); }
+    QString description() const override { return id(); }
+
+    void handleTriggerQuery(Query *query) override
+    {
+        for (int i = 0; i < row_count && query->isValid(); i += batch_)
+        {
+            if (interval_ > 0)
+                this_thread::sleep_for(microseconds(interval_));
+            query->add(vector<shared_ptr<Item>>(items_.begin() + i,
+                                                items_.begin() + min(i + batch_, row_count)));
+        }
+    }
+
+private:
+
+    const int batch_;
+    const int interval_;
+    vector<shared_ptr<Item>> items_;
+
+};
+
+
+struct Delivery
+{
+    qint64 total_ns;
+    qint64 first_row_ns;
+    qint64 main_thread_ns;
+    PerfCounters::Sample main_thread_counters;
+    uint queued_events;
+};
+
+}
+
+static void addScenarios()
+{
+    QTest::addColumn<int>("batch");
+    QTest::addColumn<int>("interval_us");
+    QTest::newRow("1, burst") << 1 << 0;
+    QTest::newRow("10, burst") << 10 << 0;
+    QTest::newRow("100, burst") << 100 << 0;
+    QTest::newRow("1000, burst") << 1000 << 0;
+    QTest::newRow("1 per 100 us") << 1 << 100;
+    QTest::newRow("10 per 1 ms") << 10 << 1000;
+    QTest::newRow("100 per 10 ms") << 100 << 10000;
+}
+
+// Runs the scenario of the current data row once. Warns and returns nothing if the delivery failed.
+static optional<Delivery> deliver()
+{
+    QFETCH(int, batch);
+    QFETCH(int, interval_us);
+
+    BatchHandler handler(batch, interval_us);
+    AccountingExecutor executor;
+    QueryExecution query(nullptr, {}, &handler, QString(), QStringLiteral("bench "));
+    QAbstractItemModelTester tester(query.matches(),
+                                    QAbstractItemModelTester::FailureReportingMode::QtTest);
+
+    Delivery delivery{};
+    QElapsedTimer timer;
+
+    QEventLoop loop;
+    QObject::connect(query.matches(), &QAbstractItemModel::rowsInserted, &loop, [&]{
+        if (delivery.first_row_ns == 0)
+            delivery.first_row_ns = timer.nsecsElapsed();
+    });
+    QObject::connect(&query, &Query::finished, &loop, &QEventLoop::quit);
+    QTimer::singleShot(timeout, &loop, &QEventLoop::quit);
+
+    timer.start();
+    query.run();
+    loop.exec();
+
+    delivery.total_ns = timer.nsecsElapsed();
+    delivery.main_thread_ns = executor.main_thread_ns;
+    delivery.main_thread_counters = executor.main_thread_counters;
+    delivery.queued_events = executor.posted;
+
+    if (!query.isFinished())
+        qWarning("Query did not finish in time");
+    else if (query.matches()->rowCount() != row_count)
+        qWarning("Rows missing: %d of %d", query.matches()->rowCount(), row_count);
+    else
+        return delivery;
+    return {};
+}
+
+// The deliveries of the runs of the current data row. The metrics share the
+// runs of a scenario. Empty if a run failed.
+static const vector<Delivery> &deliveries()
+{
+    static map<QByteArray, vector<Delivery>> scenarios;
+
+    const QByteArray tag = QTest::currentDataTag();
+    if (auto it = scenarios.find(tag); it != scenarios.end())
+        return it->second;
+
+    vector<Delivery> scenario;
+    for (int run = 0; run < runs; ++run)
+        if (auto d = deliver(); d)
+            scenario.push_back(::move(*d));
+        else
+        {
+            scenario.clear();
+            break;
+        }
+    return scenarios.emplace(tag, ::move(scenario)).first->second;
+}
+
+template<class T>
+static qreal median(const vector<Delivery> &deliveries, T Delivery::*metric)
+{
+    vector<T> values;
+    for (const auto &d : deliveries)
+        values.push_back(d.*metric);
+    auto mid = values.begin() + values.size() / 2;
+    nth_element(values.begin(), mid, values.end());
+    return (qreal)*mid;
+}
+
+void DeliveryBench::throughput_data() { addScenarios(); }
+
+void DeliveryBench::throughput()
+{
+    // The inverse throughput, i.e. the wall time per delivered row
+    const auto &d = deliveries();
+    if (d.empty())
+        QFAIL("Delivery failed");
+    QTest::setBenchmarkResult(median(d, &Delivery::total_ns) / row_count,
+                              QTest::WalltimeNanoseconds);
+}
+
+void DeliveryBench::mainThreadTimePerRow_data() { addScenarios(); }
+
+void DeliveryBench::mainThreadTimePerRow()
+{
+    // Collecting and inserting, including the checks of the model tester
+    const auto &d = deliveries();
+    if (d.empty())
+        QFAIL("Delivery failed");
+
+    PerfCounters::Sample counters;
+    for (const auto &delivery : d)
+        counters += delivery.main_thread_counters;
+    BenchCounters::log(counters / d.size(), row_count, QStringLiteral("row"));
+
+    QTest::setBenchmarkResult(median(d, &Delivery::main_thread_ns) / row_count,
+                              QTest::WalltimeNanoseconds);
+}
+
+void DeliveryBench::queuedEvents_data() { addScenarios(); }
+
+void DeliveryBench::queuedEvents()
+{
+    const auto &d = deliveries();
+    if (d.empty())
+        QFAIL("Delivery failed");
+    QTest::setBenchmarkResult(median(d, &Delivery::queued_events), QTest::Events);
+}
+
+void DeliveryBench::timeToFirstRow_data() { addScenarios(); }
+
+void DeliveryBench::timeToFirstRow()
+{
+    const auto &d = deliveries();
+    if (d.empty())
+        QFAIL("Delivery failed");
+    QTest::setBenchmarkResult(median(d, &Delivery::first_row_ns) / 1e6,
+                              QTest::WalltimeMilliseconds);
+}
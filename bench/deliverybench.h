@@ -0,0 +1,34 @@
+// Copyright (c) 2024 Manuel Schneider
+
+#pragma once
+#include <QtTest/QtTest>
+
+///
+/// Benchmarks the delivery of results from handlers to the model.
+///
+/// A handler adds a fixed number of items in batches at a fixed rate. The
+/// query runs on the default executor and the event loop, with a model tester
+/// attached to the matches.
+///
+/// Each scenario runs a few times, once for all metrics. The metrics are the
+/// medians of the runs.
+///
+class DeliveryBench : public QObject
+{
+    Q_OBJECT
+
+private slots:
+
+    void throughput_data();
+    void throughput();
+
+    void mainThreadTimePerRow_data();
+    void mainThreadTimePerRow();
+
+    void queuedEvents_data();
+    void queuedEvents();
+
+    void timeToFirstRow_data();
+    void timeToFirstRow();
+
+};
@@ -0,0 +1,272 @@
+// Copyright (c) 2024 Manuel Schneider
+
+#include "benchcounters.h"
+#include "iconbench.h"
+#include "iconlookup.h"
+#include "iconprovider.h"
+#include <QIcon>
+#include <QImage>
+#include <QImageReader>
+#include <QPainter>
+#include <QPixmapCache>
+using namespace albert;
+using namespace std;
+
+static const QString theme = QStringLiteral("bench");
+static const int icon_count = 100;  // Per set
+static const int decode_size = 256;
+static const QList<int> sizes{8, 12, 16, 20, 22, 24, 32, 36, 40, 48, 64, 72, 96, 128, 192, 256, 512};
+static const QList<int> requested_sizes{16, 32, 64, 128, 256};
+static const QStringList contexts{"actions", "apps", "devices", "mimetypes", "places", "status"};
+static const QStringList formats{"png", "svg", "xpm"};
+
+// The icon sets and the themes containing them
+static const QList<pair<QString, QString>> sets{
+    {"theme", "bench"},
+    {"inherited", "bench-mid-2"},
+    {"hicolor", "hicolor"},
+    {"missing", {}}
+};
+
+static QString iconName(const QString &set, int k) { return QString("%1-%2").arg(set).arg(k); }
+
+static QStringList iconNames(const QString &set)
+{
+    QStringList names;
+    for (int k = 0; k < icon_count; ++k)
+        names << iconName(set, k);
+    return names;
+}
+
+static QStringList themeDirectories()
+{
+    QStringList dirs;
+    for (const auto &context : contexts)
+    {
+        for (int size : sizes)
+        {
+            dirs << QString("%1x%1/%2").arg(size).arg(context);
+            dirs << QString("%1x%1@2/%2").arg(size).arg(context);
+        }
+        dirs << QString("scalable/%1").arg(context);
+    }
+    return dirs;
+}
+
+// The pixel size of the icons in a theme directory
+static int directorySize(const QString &dir)
+{
+    if (dir.startsWith("scalable"))
+        return 64;
+    return dir.section('x', 0, 0).toInt() * (dir.contains('@') ? 2 : 1);
+}
+
+static void writeTheme(const QDir &icons, const QString &name, const QString &inherits)
+{
+    const QDir dir(icons.filePath(name));
+    const auto dirs = themeDirectories();
+
+    QString index = QString("[Icon Theme]\nName=%1\n").arg(name);
+    if (!inherits.isEmpty())
+        index += QString("Inherits=%1\n").arg(inherits);
+    index += QString("Directories=%1\n").arg(dirs.join(','));
+
+    for (const auto &d : dirs)
+    {
+        dir.mkpath(d);
+        index += QString("\n[%1]\nContext=%2\n").arg(d, d.section('/', 1));
+        if (d.startsWith("scalable"))
+            index += "Size=64\nMinSize=8\nMaxSize=512\nType=Scalable\n";
+        else
+            index += QString("Size=%1\nType=Fixed\nScale=%2\n")
+                         .arg(d.section('x', 0, 0), d.contains('@') ? QStringLiteral("2") : QStringLiteral("1"));
+    }
+
+    QFile file(dir.filePath("index.theme"));
+    if (!file.open(QIODevice::WriteOnly))
+        qFatal("Unable to write %s", qPrintable(file.fileName()));
+    file.write(index.toUtf8());
+}
+
+static void writeIcon(const QString &path, const QString &format, int size)
+{
+    if (format == "svg")
+    {
+        QFile file(path);
+        if (!file.open(QIODevice::WriteOnly))
+            qFatal("Unable to write %s", qPrintable(path));
+        file.write(QString("<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%1\" height=\"%1\">"
+                           "<circle cx=\"%2\" cy=\"%2\" r=\"%2\" fill=\"#3daee9\"/></svg>")
+                       .arg(size).arg(size / 2.).toUtf8());
+    }
+    else
+    {
+        QImage image(size, size, QImage::Format_ARGB32);
+        image.fill(Qt::transparent);
+        QPainter p(&image);
+        p.setRenderHint(QPainter::Antialiasing);
+        p.setPen(Qt::NoPen);
+        p.setBrush(QColor("#3daee9"));
+        p.drawEllipse(image.rect());
+        p.end();
+        if (!image.save(path, qPrintable(format)))
+            qFatal("Unable to write %s", qPrintable(path));
+    }
+}
+
+static QString decodeUrl(const QDir &dir, const QString &format)
+{ return QString("file:%1").arg(dir.filePath(QString("icon.%1").arg(format))); }
+
+static void addDecodeRows()
+{
+    QTest::addColumn<QString>("format");
+    QTest::addColumn<int>("size");
+    for (const auto &format : formats)
+        for (int size : requested_sizes)
+            QTest::addRow("%s %d", qPrintable(format), size) << format << size;
+}
+
+static bool canDecode(const QString &format)
+{ return QImageReader::supportedImageFormats().contains(format.toLatin1()); }
+
+void IconBench::initTestCase()
+{
+    QVERIFY(dir_.isValid());
+
+    const QDir share(dir_.filePath("share"));
+    const QDir icons(share.filePath("icons"));
+    writeTheme(icons, "bench", "bench-mid-1,bench-mid-2");
+    writeTheme(icons, "bench-mid-1", "bench-base");
+    writeTheme(icons, "bench-mid-2", "bench-base");
+    writeTheme(icons, "bench-base", "hicolor");
+    writeTheme(icons, "hicolor", {});
+
+    // Spread the icons of a set over the directories and formats
+    const auto dirs = themeDirectories();
+    for (const auto &[set, set_theme] : sets)
+        if (!set_theme.isEmpty())
+            for (int k = 0; k < icon_count; ++k)
+            {
+                const auto &d = dirs[(k * 7) % dirs.size()];
+                const auto &format = formats[k % formats.size()];
+                writeIcon(icons.filePath(QString("%1/%2/%3.%4")
+                                             .arg(set_theme, d, iconName(set, k), format)),
+                          format, min(directorySize(d), 512));
+            }
+
+    const QDir decode(dir_.filePath("decode"));
+    decode.mkpath(".");
+    for (const auto &format : formats)
+        writeIcon(decode.filePath(QString("icon.%1").arg(format)), format, decode_size);
+
+    // Before the first lookup of the process. The system pixmap dirs are searched as well.
+    qputenv("XDG_DATA_DIRS", share.path().toLocal8Bit());
+    QIcon::setThemeSearchPaths({icons.path()});
+    QIcon::setThemeName(theme);
+
+    // Measure decoding, not the pixmap cache
+    QPixmapCache::setCacheLimit(0);
+}
+
+void IconBench::lookup_data()
+{
+    QTest::addColumn<QString>("set");
+    for (const auto &[set, set_theme] : sets)
+        QTest::newRow(qPrintable(set)) << set;
+}
+
+void IconBench::lookup()
+{
+    QFETCH(QString, set);
+
+    // Cold lookups of icon_count names
+    const auto names = iconNames(set);
+    QString path;
+    BenchCounters counters;
+    QBENCHMARK_ONCE {
+        for (const auto &name : names)
+        {
+            path = XDG::IconLookup::iconPath(name, {}, theme);
+            counters.iterate();
+        }
+    }
+    QCOMPARE(path.isNull(), set == "missing");
+}
+
+void IconBench::lookupCached_data()
+{
+    QTest::addColumn<QString>("name");
+    QTest::newRow("hit") << iconName("inherited", 0);
+    QTest::newRow("miss") << iconName("missing", 0);
+}
+
+void IconBench::lookupCached()
+{
+    QFETCH(QString, name);
+
+    XDG::IconLookup::iconPath(name, {}, theme);
+    BenchCounters counters;
+    QBENCHMARK {
+        XDG::IconLookup::iconPath(name, {}, theme);
+        counters.iterate();
+    }
+}
+
+void IconBench::themeIcon_data() { lookup_data(); }
+
+void IconBench::themeIcon()
+{
+    QFETCH(QString, set);
+
+    // Cold lookups and decoding of icon_count names by the Qt icon loader
+    const auto names = iconNames(set);
+    QPixmap pm;
+    BenchCounters counters;
+    QBENCHMARK_ONCE {
+        for (const auto &name : names)
+        {
+            pm = albert::pixmapFromUrl(QString("xdg:%1").arg(name), QSize(32, 32));
+            counters.iterate();
+        }
+    }
+    QVERIFY(!pm.isNull() || set == "missing");
+}
+
+void IconBench::pixmapFromUrl_data() { addDecodeRows(); }
+
+void IconBench::pixmapFromUrl()
+{
+    QFETCH(QString, format);
+    QFETCH(int, size);
+    if (!canDecode(format))
+        QSKIP("No image format plugin");
+
+    // Decoding and scaling of a source of decode_size pixels
+    const auto url = decodeUrl(QDir(dir_.filePath("decode")), format);
+    QPixmap pm;
+    BenchCounters counters;
+    QBENCHMARK {
+        pm = albert::pixmapFromUrl(url, QSize(size, size));
+        counters.iterate();
+    }
+    QCOMPARE(pm.width(), size);
+}
+
+void IconBench::iconFromUrl_data() { addDecodeRows(); }
+
+void IconBench::iconFromUrl()
+{
+    QFETCH(QString, format);
+    QFETCH(int, size);
+    if (!canDecode(format))
+        QSKIP("No image format plugin");
+
+    const auto url = decodeUrl(QDir(dir_.filePath("decode")), format);
+    QPixmap pm;
+    BenchCounters counters;
+    QBENCHMARK {
+        pm = albert::iconFromUrl(url).pixmap(QSize(size, size));
+        counters.iterate();
+    }
+    QVERIFY(!pm.isNull());
+}
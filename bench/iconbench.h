@@ -0,0 +1,45 @@
+// Copyright (c) 2024 Manuel Schneider
+
+#pragma once
+#include <QTemporaryDir>
+#include <QtTest/QtTest>
+
+///
+/// Benchmarks icon lookup and decoding on synthetic XDG icon themes.
+///
+/// The themes are generated in a temporary XDG_DATA_DIRS. The theme in use
+/// inherits from two themes, which inherit from a common base and hicolor.
+/// Each theme has some hundred directories of sizes, scales and contexts.
+/// Icons are PNG, SVG and XPM files.
+///
+/// Lookups are cached by name. Cold lookups use names not looked up before,
+/// hence they run once for a set of names.
+///
+class IconBench : public QObject
+{
+    Q_OBJECT
+
+private slots:
+
+    void initTestCase();
+
+    void lookup_data();
+    void lookup();
+
+    void lookupCached_data();
+    void lookupCached();
+
+    void themeIcon_data();
+    void themeIcon();
+
+    void pixmapFromUrl_data();
+    void pixmapFromUrl();
+
+    void iconFromUrl_data();
+    void iconFromUrl();
+
+private:
+
+    QTemporaryDir dir_;
+
+};
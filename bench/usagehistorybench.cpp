@@ -0,0 +1,195 @@
+// Copyright (c) 2024 Manuel Schneider
+
+#include "benchcounters.h"
+#include "rankitem.h"
+#include "standarditem.h"
+#include "usagedatabase.h"
+#include "usagehistorybench.h"
+#include "util.h"
+#include <QDateTime>
+#include <QDir>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <random>
+using namespace albert;
+using namespace std;
+
+static const char *db_conn_name = "usagehistory";  // See usagedatabase.cpp
+static const uint extension_count = 8;
+static const uint items_per_activations = 10;  // Distinct items per activation count
+static const int history_days = 3 * 365;
+static const uint result_count = 10000;
+
+static void addSizes()
+{
+    QTest::addColumn<uint>("activations");
+    QTest::newRow("10k") << 10000u;
+    QTest::newRow("100k") << 100000u;
+    QTest::newRow("1M") << 1000000u;
+}
+
+// The item of popularity rank r. Items are spread over the extensions.
+static QString extensionId(uint r) { return QString("ext%1").arg(r % extension_count); }
+static QString itemId(uint r) { return QString("item%1").arg(r); }
+static QString itemText(uint r) { return QString::number(r, 36); }
+
+static void generate(const QString &path, uint count)
+{
+    {
+        auto db = QSqlDatabase::addDatabase("QSQLITE", "bench");
+        db.setDatabaseName(QDir(path).filePath("albert.db"));
+        if (!db.open())
+            qFatal("Unable to create database: %s", qPrintable(db.lastError().text()));
+
+        QSqlQuery sql(db);
+        sql.exec("CREATE TABLE activation ( "
+                 "    timestamp INTEGER DEFAULT CURRENT_TIMESTAMP, "
+                 "    query TEXT, "
+                 "    extension_id, "
+                 "    item_id TEXT, "
+                 "    action_id TEXT "
+                 "); ");
+
+        // Zipfian popularity, s = 1
+        const uint items = max(count / items_per_activations, 1u);
+        vector<double> weights(items);
+        for (uint r = 0; r < items; ++r)
+            weights[r] = 1.0 / (r + 1);
+        discrete_distribution<uint> popularity(weights.begin(), weights.end());
+        uniform_int_distribution<int> percent(0, 99);
+        mt19937 rng(count);  // Reproducible
+
+        // Ascending timestamps, as activations are appended
+        const auto end = QDateTime::currentDateTimeUtc();
+        const auto begin = end.addDays(-history_days);
+        const qint64 span = begin.secsTo(end);
+
+        db.transaction();
+        sql.prepare("INSERT INTO activation (timestamp, query, extension_id, item_id, action_id) "
+                    "VALUES (:timestamp, :query, :extension_id, :item_id, :action_id);");
+        for (uint i = 0; i < count; ++i)
+        {
+            const auto r = popularity(rng);
+            const auto text = itemText(r);
+            const auto p = percent(rng);
+
+            sql.bindValue(":timestamp", begin.addSecs(span * i / count)
+                                            .toString("yyyy-MM-dd hh:mm:ss"));
+            // Some activations from the empty query, the rest from a prefix
+            sql.bindValue(":query", p < 10 ? QString() : text.left(1 + p % text.size()));
+            sql.bindValue(":extension_id", extensionId(r));
+            // Some activations of items without id, e.g. fallbacks
+            sql.bindValue(":item_id", p < 2 ? QString() : itemId(r));
+            sql.bindValue(":action_id", QString("action%1").arg(p % 3));
+            if (!sql.exec())
+                qFatal("SQL ERROR: %s", qPrintable(sql.lastError().text()));
+        }
+        db.commit();
+    }
+    QSqlDatabase::removeDatabase("bench");
+}
+
+void UsageHistoryBench::initTestCase()
+{
+    QVERIFY(dir_.isValid());
+    qputenv("XDG_CONFIG_HOME", dir_.filePath("config").toLocal8Bit());
+}
+
+void UsageHistoryBench::useHistory(uint count)
+{
+    qputenv("XDG_DATA_HOME", dir_.filePath(QString::number(count)).toLocal8Bit());
+
+    if (!generated_.contains(count))
+    {
+        QVERIFY(QDir().mkpath(dataLocation()));
+        QElapsedTimer t;
+        t.start();
+        generate(dataLocation(), count);
+        qDebug() << "Generated" << count << "activations in" << t.elapsed() << "ms";
+        generated_.insert(count);
+    }
+
+    QSqlDatabase::removeDatabase(db_conn_name);
+    UsageHistory::initialize();
+    QVERIFY(!UsageHistory::itemScores(extensionId(0)).empty());
+}
+
+void UsageHistoryBench::initialize_data() { addSizes(); }
+
+void UsageHistoryBench::initialize()
+{
+    QFETCH(uint, activations);
+    useHistory(activations);
+
+    // The startup load on the main thread: connect, read and score
+    BenchCounters counters;
+    QBENCHMARK {
+        QSqlDatabase::removeDatabase(db_conn_name);
+        UsageHistory::initialize();
+        counters.iterate();
+    }
+}
+
+void UsageHistoryBench::updateScores_data() { addSizes(); }
+
+void UsageHistoryBench::updateScores()
+{
+    QFETCH(uint, activations);
+    useHistory(activations);
+
+    // Setting the memory decay recomputes the scores
+    const auto decay = UsageHistory::memoryDecay();
+    BenchCounters counters;
+    QBENCHMARK {
+        UsageHistory::setMemoryDecay(decay);
+        counters.iterate();
+    }
+}
+
+void UsageHistoryBench::applyScores_data() { addSizes(); }
+
+void UsageHistoryBench::applyScores()
+{
+    QFETCH(uint, activations);
+    useHistory(activations);
+
+    // Results of one extension. Every other one is an item of the history.
+    const auto extension_id = extensionId(0);
+    const uint items = max(activations / items_per_activations, 1u);
+    vector<RankItem> rank_items;
+    vector<double> match_scores;
+    for (uint i = 0; i < result_count; ++i)
+    {
+        const auto r = i * extension_count % items;
+        const auto id = i % 2 ? itemId(r) : QString("unused%1").arg(i);
+        rank_items.emplace_back(make_shared<StandardItem>(id, itemText(r)), 0.);
+        match_scores.emplace_back((i % 4) / 3.);  // 0, 1/3, 2/3 and perfect matches
+    }
+
+    // Per result cost is the measurement over result_count
+    BenchCounters counters;
+    QBENCHMARK {
+        for (uint i = 0; i < result_count; ++i)
+            rank_items[i].score = match_scores[i];
+        UsageHistory::applyScores(extension_id, rank_items);
+        counters.iterate();
+    }
+}
+
+void UsageHistoryBench::addActivation_data() { addSizes(); }
+
+void UsageHistoryBench::addActivation()
+{
+    QFETCH(uint, activations);
+    useHistory(activations);
+
+    // An insert and a full score update. Grows the history slightly.
+    uint r = 0;
+    BenchCounters counters;
+    QBENCHMARK {
+        UsageHistory::addActivation(itemText(r), extensionId(r), itemId(r), "action0");
+        ++r;
+        counters.iterate();
+    }
+}
@@ -0,0 +1,42 @@
+// Copyright (c) 2024 Manuel Schneider
+
+#pragma once
+#include <QTemporaryDir>
+#include <QtTest/QtTest>
+#include <set>
+
+///
+/// Benchmarks the usage history on synthetic activation histories.
+///
+/// Histories have a Zipfian item popularity and span several years. Each size
+/// is generated once in a temporary data location.
+///
+class UsageHistoryBench : public QObject
+{
+    Q_OBJECT
+
+private slots:
+
+    void initTestCase();
+
+    void initialize_data();
+    void initialize();
+
+    void updateScores_data();
+    void updateScores();
+
+    void applyScores_data();
+    void applyScores();
+
+    void addActivation_data();
+    void addActivation();
+
+private:
+
+    /// Points the usage history to a history of count activations.
+    void useHistory(uint count);
+
+    QTemporaryDir dir_;
+    std::set<uint> generated_;
+
+};
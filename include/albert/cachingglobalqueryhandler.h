@@ -0,0 +1,56 @@
+// SPDX-FileCopyrightText: 2024 Manuel Schneider
+// SPDX-License-Identifier: MIT
+
+#pragma once
+#include <albert/globalqueryhandler.h>
+#include <albert/resultcache.h>
+#include <memory>
+
+namespace albert
+{
+
+///
+/// A global query handler memoizing its results.
+///
+/// Use this if the results depend only on the query string and the data of
+/// the handler. Call invalidateResultCache() whenever the data changes.
+/// Results of cancelled queries are not cached.
+///
+class ALBERT_EXPORT CachingGlobalQueryHandler : public GlobalQueryHandler
+{
+public:
+
+    /// @param max_items The maximum number of cached rank items.
+    CachingGlobalQueryHandler(size_t max_items = 10000);
+
+    /// The uncached query handling function.
+    /// @see GlobalQueryHandler::handleGlobalQuery
+    /// @note Executed in a worker thread.
+    virtual std::vector<RankItem> handleUncachedGlobalQuery(const Query*) = 0;
+
+    /// The cache key of a query. Defaults to the simplified query string.
+    /// Reimplement if equivalent queries can be normalized further.
+    virtual QString cacheKey(const Query*) const;
+
+    /// Returns the cached results or calls handleUncachedGlobalQuery.
+    std::vector<RankItem> handleGlobalQuery(const Query*) override final;
+
+    /// Drops the cached results.
+    /// @threadsafe
+    void invalidateResultCache();
+
+    /// The result cache.
+    ResultCache &resultCache();
+
+protected:
+
+    ~CachingGlobalQueryHandler() override;
+
+private:
+
+    class Private;
+    std::unique_ptr<Private> d;
+
+};
+
+}
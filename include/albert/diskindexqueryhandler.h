@@ -0,0 +1,93 @@
+// SPDX-FileCopyrightText: 2024 Manuel Schneider
+// SPDX-License-Identifier: MIT
+
+#pragma once
+#include <QString>
+#include <QStringList>
+#include <albert/globalqueryhandler.h>
+#include <memory>
+#include <vector>
+
+namespace albert
+{
+
+///
+/// Out-of-core index query handler class.
+///
+/// A GlobalQueryHandler for catalogues too large to be held in memory, e.g.
+/// millions of file paths. Entries are a lookup string and a list of stored
+/// fields. They are written to memory mapped index shards in the cache
+/// location and persist across sessions. Items are created from the stored
+/// fields for the best matches only.
+///
+/// @note Matching is prefix based. Fuzzy matching is not supported.
+///
+class ALBERT_EXPORT DiskIndexQueryHandler : public GlobalQueryHandler
+{
+public:
+
+    ///
+    /// Writes a new index generation.
+    ///
+    /// The new entries replace the current index on commit(). Destroying an
+    /// uncommitted writer discards the entries. Writers may outlive their
+    /// handler, committing fails then.
+    ///
+    class ALBERT_EXPORT Writer final
+    {
+    public:
+
+        Writer(Writer &&);
+        ~Writer();
+
+        /// Adds an entry.
+        /// @param string The lookup string
+        /// @param fields The stored fields passed to createItem
+        void add(const QString &string, const QStringList &fields);
+
+        /// Replaces the current index with the added entries.
+        /// @return false if writing the index failed.
+        bool commit();
+
+    private:
+
+        friend class DiskIndexQueryHandler;
+        class Private;
+        Writer(std::unique_ptr<Private>);
+        std::unique_ptr<Private> d;
+
+    };
+
+    DiskIndexQueryHandler();
+
+    /// Creates the item of an entry from its stored fields.
+    /// Called for the best matches of a query only.
+    /// @note Executed in a worker thread.
+    virtual std::shared_ptr<Item> createItem(const QStringList &fields) const = 0;
+
+    /// Returns a writer for a new index generation.
+    /// Call this whenever the catalogue changed.
+    /// @threadsafe
+    Writer indexWriter();
+
+    /// Searches the index and creates the items of the best matches.
+    std::vector<RankItem> handleGlobalQuery(const Query*) override;
+
+    /// The maximum number of items created per query. Defaults to 100.
+    uint resultLimit() const;
+
+    /// Sets the maximum number of items created per query.
+    void setResultLimit(uint);
+
+protected:
+
+    ~DiskIndexQueryHandler() override;
+
+private:
+
+    class Private;
+    std::shared_ptr<Private> d;  // Shared with the writers
+
+};
+
+}
@@ -7,9 +7,11 @@
 #include <albert/indexitem.h>
 #include <memory>
 #include <vector>
+class GlobalQuery;
 
 namespace albert
 {
+class ItemIndex;
 
 /// Index query handler class.
 /// A GlobalQueryHandler providing implicit indexing and matching.
@@ -40,17 +42,50 @@ public:
 
     /// Set the items of the index.
     /// Call this in updateIndexItems().
+    /// Queries use the previous items until the new index is built. If there
+    /// are none, large indices are published partially while building, the
+    /// most frequently used items first.
     /// @threadsafe
     void setIndexItems(std::vector<IndexItem>&&);
 
+    /// Returns true if the items are contributed to the federated index.
+    /// Handlers matching other than the federated index, e.g. any word, are
+    /// never federated.
+    bool isFederated() const;
+
+    /// Contribute the items to the index shared by all federated handlers.
+    /// Global queries then search all federated handlers in a single pass.
+    /// Opt in only if handleGlobalQuery and applyUsageScore are not overridden.
+    /// Triggers a rebuild by calling updateIndexItems.
+    void setFederated(bool);
+
+    /// Returns true if items matching any of the query words are returned.
+    bool matchAnyWord() const;
+
+    /// Return items matching any of the query words instead of all words.
+    /// Global queries return the best matches only.
+    /// Triggers a rebuild by calling updateIndexItems.
+    void setMatchAnyWord(bool);
+
 protected:
 
     ~IndexQueryHandler() override;
 
+    /// Returns true if global queries may match the index directly, bypassing
+    /// handleGlobalQuery and applyUsageScore. Then no RankItems are created for
+    /// the results that are not displayed. Returns false by default.
+    /// Opt in only if handleGlobalQuery and applyUsageScore are not overridden.
+    virtual bool matchesIndexDirectly() const;
+
 private:
 
+    /// The index snapshot global queries match directly, using limit.
+    /// Null if the handler does not opt in or the items are federated.
+    std::shared_ptr<const ItemIndex> globalQueryIndex(uint &limit) const;
+
     class Private;
     std::unique_ptr<Private> d;
+    friend class ::GlobalQuery;
 
 };
 
@@ -15,6 +15,8 @@ namespace albert
 ///
 /// Stores input strings and provides a search iterator.
 ///
+/// The history file is an append-only journal which is compacted occasionally.
+///
 class ALBERT_EXPORT InputHistory final : public QObject
 {
     Q_OBJECT
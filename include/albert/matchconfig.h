@@ -30,6 +30,10 @@ public:
     /// Match strings error tolerant.
     bool fuzzy = false;
 
+    /// Match strings containing any of the words instead of all words.
+    /// The score is the fraction of matched chars.
+    bool match_any_word = false;
+
     ///
     /// The error tolerance.
     ///
@@ -0,0 +1,80 @@
+// SPDX-FileCopyrightText: 2024 Manuel Schneider
+// SPDX-License-Identifier: MIT
+
+#pragma once
+#include <QString>
+#include <QStringList>
+#include <albert/export.h>
+#include <albert/rankitem.h>
+#include <memory>
+#include <optional>
+#include <vector>
+
+namespace albert
+{
+
+///
+/// A memoizing cache for query results.
+///
+/// Results are cached per query key and evicted least recently used if the
+/// total number of cached rank items exceeds the limit. Results computed
+/// before the last invalidate() are never stored nor returned.
+///
+/// @threadsafe
+///
+class ALBERT_EXPORT ResultCache final
+{
+public:
+
+    /// Cache statistics.
+    struct Stats
+    {
+        uint64_t hits = 0;       ///< Lookups returning results
+        uint64_t misses = 0;     ///< Lookups returning nothing
+        uint64_t evictions = 0;  ///< Entries evicted due to the item limit
+        size_t entries = 0;      ///< Currently cached queries
+        size_t items = 0;        ///< Currently cached rank items
+
+        /// The fraction of lookups returning results.
+        double hitRate() const;
+    };
+
+    /// @param name The name used in reports, e.g. the handler id.
+    /// @param max_items The maximum number of cached rank items.
+    ResultCache(const QString &name, size_t max_items = 10000);
+    ~ResultCache();
+
+    /// The current generation. Pass it to put() when starting a computation.
+    uint64_t generation() const;
+
+    /// Drops all results and increments the generation.
+    /// Call this when the data the results depend on changed.
+    void invalidate();
+
+    /// Returns the cached results of key, if any.
+    std::optional<std::vector<RankItem>> get(const QString &key);
+
+    /// Caches the results of key if generation is still current.
+    void put(const QString &key, uint64_t generation, std::vector<RankItem> results);
+
+    /// Evicts least recently used entries until at most max_items are cached.
+    void trim(size_t max_items);
+
+    /// The statistics of this cache.
+    Stats stats() const;
+
+    /// The statistics of all caches, formatted for logs and the RPC.
+    static QStringList report();
+
+    /// Trims all caches to max_items.
+    /// @return The number of rank items retained by all caches.
+    static size_t trimAll(size_t max_items);
+
+private:
+
+    class Private;
+    std::unique_ptr<Private> d;
+
+};
+
+}
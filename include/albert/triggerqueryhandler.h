@@ -49,6 +49,21 @@ public:
     /// @note Executed in a worker thread.
     virtual void handleTriggerQuery(Query*) = 0;
 
+    /// Called when the frontend is about to show.
+    /// Reimplement this to prefetch or refresh data before the first query.
+    /// Default does nothing.
+    /// @note Executed in the main thread. Do not block, start long running
+    /// work asynchronously.
+    /// @since 0.27
+    virtual void aboutToShow();
+
+    /// Called when the frontend has been hidden.
+    /// Reimplement this to release transient caches.
+    /// Default does nothing.
+    /// @note Executed in the main thread.
+    /// @since 0.27
+    virtual void hidden();
+
 protected:
 
     ~TriggerQueryHandler() override;
@@ -6,6 +6,7 @@
 #include "frontend.h"
 #include "iconprovider.h"
 #include "logging.h"
+#include "memorytrimmer.h"
 #include "messagehandler.h"
 #include "platform.h"
 #include "plugininstance.h"
@@ -16,8 +17,10 @@
 #include "pluginswidget.h"
 #include "qtpluginprovider.h"
 #include "queryengine.h"
+#include "querylatency.h"
 #include "querywidget.h"
 #include "report.h"
+#include "resultcache.h"
 #include "rpcserver.h"
 #include "session.h"
 #include "settingswindow.h"
@@ -90,6 +93,7 @@ public:
     std::unique_ptr<QSystemTrayIcon> tray_icon{nullptr};
     std::unique_ptr<QMenu> tray_menu{nullptr};
     std::unique_ptr<Session> session{nullptr};
+    std::unique_ptr<MemoryTrimmer> memory_trimmer{nullptr};
     QPointer<SettingsWindow> settings_window{nullptr};
 
     AppQueryHandler app_query_handler;
@@ -116,14 +120,17 @@ void App::Private::initialize()
 
     platform::initNativeWindow(frontend->winId());
 
-    // Invalidate sessions on handler removal or visibility change
-    auto reset_session = [this]{
+    // The session lives across show and hide to keep its results warm.
+    // Queries may reference removed handlers, hence reset on removal.
+    session = make_unique<Session>(query_engine, *frontend);
+    connect(&query_engine, &QueryEngine::handlerRemoved, app_instance, [this]{
         session.reset();
-        if (frontend->isVisible())
-            session = make_unique<Session>(query_engine, *frontend);
-    };
-    connect(frontend, &Frontend::visibleChanged, app_instance, reset_session);
-    connect(&query_engine, &QueryEngine::handlerRemoved, app_instance, reset_session);
+        session = make_unique<Session>(query_engine, *frontend);
+    });
+    connect(&query_engine, &QueryEngine::handlerAdded, app_instance,
+            [this]{ session->invalidate(); });
+
+    memory_trimmer = make_unique<MemoryTrimmer>(*frontend);
 
     if (settings()->value(CFG_SHOWTRAY, DEF_SHOWTRAY).toBool())
         initTrayIcon();
@@ -154,6 +161,7 @@ void App::Private::finalize()
     }
 
     delete settings_window.get();
+    memory_trimmer.reset();
     session.reset();
 
     extension_registry.deregisterExtension(&plugin_provider);  // unloads plugins
@@ -283,6 +291,19 @@ void App::Private::initPRC()
         }},
         {"report", [](const QString&){
             return report().join('\n');
+        }},
+        {"latency", [](const QString&){
+            return QueryLatency::report().join('\n');
+        }},
+        {"cache", [](const QString&){
+            return ResultCache::report().join('\n');
+        }},
+        {"memory", [this](const QString &arg){
+            if (!memory_trimmer)
+                return QStringLiteral("Not initialized.");
+            if (arg == QStringLiteral("trim"))
+                memory_trimmer->trim();
+            return memory_trimmer->report().join('\n');
         }}
     };
 
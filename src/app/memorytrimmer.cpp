@@ -0,0 +1,141 @@
+// Copyright (c) 2024 Manuel Schneider
+
+#include "frontend.h"
+#include "itemindex.h"
+#include "logging.h"
+#include "memorytrimmer.h"
+#include "resultcache.h"
+#include "util.h"
+#include <QDateTime>
+#include <QFile>
+#include <QPixmapCache>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+#if defined(Q_OS_LINUX)
+#include <unistd.h>
+#endif
+using namespace albert;
+using namespace std;
+
+static const char *CFG_TRIM_DELAY = "idleTrimDelay";
+static const uint  DEF_TRIM_DELAY = 60;
+static const char *CFG_CACHE_FLOOR = "idleCacheFloor";
+static const uint  DEF_CACHE_FLOOR = 1000;
+
+namespace
+{
+
+struct MemoryStats
+{
+    qint64 rss = -1;         // Resident set size
+    qint64 heap_used = -1;   // Allocated heap
+    qint64 heap_free = -1;   // Free heap retained by the allocator
+};
+
+static MemoryStats memoryStats()
+{
+    MemoryStats s;
+
+#if defined(Q_OS_LINUX)
+    if (QFile f("/proc/self/statm"); f.open(QIODevice::ReadOnly))
+        if (auto fields = f.readAll().split(' '); fields.size() > 1)
+            s.rss = fields[1].toLongLong() * sysconf(_SC_PAGESIZE);
+#endif
+
+#if defined(__GLIBC__)
+#if __GLIBC_PREREQ(2, 33)
+    auto mi = mallinfo2();
+    s.heap_used = (qint64)mi.uordblks;
+    s.heap_free = (qint64)mi.fordblks;
+#endif
+#endif
+
+    return s;
+}
+
+static QString kib(qint64 bytes)
+{ return bytes < 0 ? QStringLiteral("n/a") : QString("%1 KiB").arg(bytes / 1024); }
+
+}
+
+MemoryTrimmer::MemoryTrimmer(Frontend &frontend):
+    frontend_(frontend)
+{
+    auto s = settings();
+    timer_.setSingleShot(true);
+    timer_.setInterval(s->value(CFG_TRIM_DELAY, DEF_TRIM_DELAY).toUInt() * 1000);
+    cache_floor_ = s->value(CFG_CACHE_FLOOR, DEF_CACHE_FLOOR).toUInt();
+
+    connect(&timer_, &QTimer::timeout, this, &MemoryTrimmer::trim);
+    connect(&frontend_, &Frontend::visibleChanged, this, &MemoryTrimmer::onVisibleChanged);
+}
+
+uint MemoryTrimmer::delay() const { return (uint)timer_.interval() / 1000; }
+
+void MemoryTrimmer::setDelay(uint seconds)
+{
+    timer_.setInterval(seconds * 1000);
+    settings()->setValue(CFG_TRIM_DELAY, seconds);
+}
+
+uint MemoryTrimmer::cacheFloor() const { return cache_floor_; }
+
+void MemoryTrimmer::setCacheFloor(uint items)
+{
+    cache_floor_ = items;
+    settings()->setValue(CFG_CACHE_FLOOR, items);
+}
+
+void MemoryTrimmer::onVisibleChanged(bool visible)
+{
+    if (visible)
+        timer_.stop();
+    else if (timer_.interval() > 0)
+        timer_.start();
+}
+
+void MemoryTrimmer::trim()
+{
+    const auto before = memoryStats();
+
+    const auto retained_items = ResultCache::trimAll(cache_floor_);
+    const auto scratch = ItemIndex::releaseScratchMemory();
+    const auto pixmaps = QPixmapCache::totalUsedSpace();  // KiB
+    QPixmapCache::clear();
+
+    bool returned = false;
+#if defined(__GLIBC__)
+    returned = malloc_trim(0) == 1;
+#endif
+
+    const auto after = memoryStats();
+
+    report_ = QStringList{
+        QString("Last trim:           %1").arg(QDateTime::currentDateTime().toString(Qt::ISODate)),
+        QString("Released scratch:    %1").arg(kib((qint64)scratch)),
+        QString("Released pixmaps:    %1").arg(kib((qint64)pixmaps * 1024)),
+        QString("Heap returned to OS: %1").arg(returned ? "yes" : "no"),
+        QString("RSS:                 %1 → %2").arg(kib(before.rss), kib(after.rss)),
+        QString("Heap used:           %1 → %2").arg(kib(before.heap_used), kib(after.heap_used)),
+        QString("Heap free:           %1 → %2").arg(kib(before.heap_free), kib(after.heap_free)),
+        QString("Retained cache:      %1 items (floor %2 per cache)").arg(retained_items).arg(cache_floor_)
+    };
+
+    INFO << "Trimmed memory. RSS" << kib(before.rss) << "→" << kib(after.rss);
+}
+
+QStringList MemoryTrimmer::report() const
+{
+    if (report_.isEmpty())
+    {
+        const auto s = memoryStats();
+        return {
+            QStringLiteral("No trim yet."),
+            QString("RSS:                 %1").arg(kib(s.rss)),
+            QString("Heap used:           %1").arg(kib(s.heap_used)),
+            QString("Heap free:           %1").arg(kib(s.heap_free))
+        };
+    }
+    return report_;
+}
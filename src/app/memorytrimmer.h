@@ -0,0 +1,47 @@
+// Copyright (c) 2024 Manuel Schneider
+
+#pragma once
+#include <QObject>
+#include <QStringList>
+#include <QTimer>
+namespace albert {
+class Frontend;
+}
+
+///
+/// Releases memory while the frontend is hidden.
+///
+/// After the frontend has been hidden for the configured delay the result
+/// caches are trimmed to a floor, index scratch buffers and decoded pixmaps
+/// are released and free heap is returned to the operating system.
+///
+class MemoryTrimmer final : public QObject
+{
+public:
+
+    MemoryTrimmer(albert::Frontend &frontend);
+
+    /// Seconds hidden before trimming. 0 disables trimming.
+    uint delay() const;
+    void setDelay(uint seconds);
+
+    /// The number of rank items retained in the result caches.
+    uint cacheFloor() const;
+    void setCacheFloor(uint items);
+
+    /// Trims now.
+    void trim();
+
+    /// The memory accounting of the last trim, formatted for the RPC.
+    QStringList report() const;
+
+private:
+
+    void onVisibleChanged(bool visible);
+
+    albert::Frontend &frontend_;
+    QTimer timer_;
+    uint cache_floor_;
+    QStringList report_;
+
+};
@@ -147,6 +147,8 @@ QString PluginQueryHandler::description() const
 QString PluginQueryHandler::defaultTrigger() const
 { return QStringLiteral("plugin "); }
 
+bool PluginQueryHandler::matchesIndexDirectly() const { return true; }
+
 void PluginQueryHandler::updateIndexItems()
 {
     vector<IndexItem> items;
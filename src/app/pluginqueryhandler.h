@@ -18,6 +18,9 @@ public:
     QString defaultTrigger() const override;
     void updateIndexItems() override;
 
+protected:
+    bool matchesIndexDirectly() const override;
+
 private:
     PluginRegistry &plugin_registry_;
 };
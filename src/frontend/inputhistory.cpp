@@ -5,19 +5,130 @@
 #include "util.h"
 #include <QDir>
 #include <QFile>
-#include <QStringList>
+#include <QHash>
+#include <QSaveFile>
 #include <QTextStream>
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
 using namespace albert;
 using namespace std;
 
+namespace
+{
+
+// Compact the journal if it has more than this many superfluous lines
+static const int journal_slack = 1000;
+
+using Trigram = uint64_t;
+
+inline Trigram trigram(const QChar *c)
+{ return (Trigram)c[0].unicode() << 32 | (Trigram)c[1].unicode() << 16 | (Trigram)c[2].unicode(); }
+
+}
+
 class InputHistory::Private
 {
 public:
     QString file_path;
-    QStringList lines_;
-    int currentLine_;
+    QFile journal;
+    int journal_lines = 0;
+
+    // Chronological lines. Null strings are removed duplicates.
+    vector<QString> lines;
+    QHash<QString, int> positions;
+    int live_lines = 0;
+
+    // Case folded trigrams to ascending line positions. May point to removed lines.
+    unordered_map<Trigram, vector<int>> trigrams;
+
+    int current_line;
+
+    void append(const QString &line);
+    void compactLines();
+    void compactJournal();
+    bool matches(int line, const QString &substring) const;
+    const vector<int> *candidates(const QString &substring) const;
 };
 
+void InputHistory::Private::append(const QString &line)
+{
+    if (auto it = positions.find(line); it != positions.end())
+    {
+        lines[*it] = QString{};
+        --live_lines;
+    }
+
+    const int position = (int)lines.size();
+    lines.emplace_back(line);
+    positions.insert(line, position);
+    ++live_lines;
+
+    const auto folded = line.toCaseFolded();
+    for (qsizetype i = 0; i + 3 <= folded.size(); ++i)
+        if (auto &postings = trigrams[trigram(folded.constData() + i)];
+            postings.empty() || postings.back() != position)
+            postings.emplace_back(position);
+
+    // Keep the removed lines bounded
+    if ((int)lines.size() > 2 * live_lines + journal_slack)
+        compactLines();
+}
+
+void InputHistory::Private::compactLines()
+{
+    auto old_lines = ::move(lines);
+    lines.clear();
+    positions.clear();
+    trigrams.clear();
+    live_lines = 0;
+    for (auto &line : old_lines)
+        if (!line.isNull())
+            append(line);
+}
+
+void InputHistory::Private::compactJournal()
+{
+    journal.close();
+
+    if (QSaveFile f(file_path); f.open(QIODevice::WriteOnly))
+    {
+        QTextStream ts(&f);
+        for (const auto &line : lines)
+            if (!line.isNull())
+                ts << line << '\n';
+        ts.flush();
+        if (f.commit())
+            journal_lines = live_lines;
+        else
+            WARN << "Compacting history file failed:" << file_path;
+    }
+    else
+        WARN << "Compacting history file failed:" << file_path;
+
+    if (!journal.open(QIODevice::WriteOnly | QIODevice::Append))
+        WARN << "Opening history file failed:" << file_path;
+}
+
+bool InputHistory::Private::matches(int l, const QString &substring) const
+{ return !lines[l].isNull() && lines[l].contains(substring, Qt::CaseInsensitive); }
+
+const vector<int> *InputHistory::Private::candidates(const QString &substring) const
+{
+    static const vector<int> none;
+    const vector<int> *shortest = nullptr;
+    const auto folded = substring.toCaseFolded();
+    for (qsizetype i = 0; i + 3 <= folded.size(); ++i)
+    {
+        auto it = trigrams.find(trigram(folded.constData() + i));
+        if (it == trigrams.end())
+            return &none;
+        if (!shortest || it->second.size() < shortest->size())
+            shortest = &it->second;
+    }
+    return shortest;  // nullptr if substring is too short to be indexed
+}
+
 
 InputHistory::InputHistory(const QString &path):
     d(make_unique<Private>())
@@ -27,59 +138,87 @@ InputHistory::InputHistory(const QString &path):
     else
         d->file_path = path;
 
-    if (QFile f(d->file_path); f.open(QIODevice::ReadOnly))
+    d->journal.setFileName(d->file_path);
+
+    if (d->journal.open(QIODevice::ReadOnly))
     {
-        QTextStream ts(&f);
+        QTextStream ts(&d->journal);
         while (!ts.atEnd())
-            d->lines_ << ts.readLine();
-        f.close();
+            if (auto line = ts.readLine(); !line.isEmpty())
+            {
+                d->append(line);
+                ++d->journal_lines;
+            }
+        d->journal.close();
     }
 
+    if (d->journal_lines > d->live_lines + journal_slack)
+        d->compactJournal();
+    else if (!d->journal.open(QIODevice::WriteOnly | QIODevice::Append))
+        WARN << "Opening history file failed:" << d->file_path;
+
     resetIterator();
 }
 
-InputHistory::~InputHistory()
-{
-    if (QFile f(d->file_path); f.open(QIODevice::WriteOnly))
-    {
-        QTextStream ts(&f);
-        for (const auto &line : d->lines_)
-            ts << line << Qt::endl;
-        f.close();
-    }
-    else
-        WARN << "Writing history file failed:" << d->file_path;
-}
+InputHistory::~InputHistory() = default;
 
 void InputHistory::add(const QString& s)
 {
     if (!s.isEmpty())
     {
-        if (d->lines_.contains(s))
-            d->lines_.removeAll(s); // Remove dups
-        d->lines_ << s;
+        d->append(s);
+
+        // Append-only. Survives unclean exits.
+        if (d->journal.isOpen()
+            && d->journal.write((s + u'\n').toUtf8()) != -1
+            && d->journal.flush())
+            ++d->journal_lines;
+        else
+            WARN << "Writing history file failed:" << d->file_path;
+
+        if (d->journal_lines > d->live_lines + journal_slack)
+            d->compactJournal();
     }
     resetIterator();
 }
 
 QString InputHistory::next(const QString &substring)
 {
-    for (int l = d->currentLine_ - 1; 0 <= l; --l)
-        // Simple hack to avoid the seemingly-noop-on-first-history-iteration on disabled clear-on-hide
-        if (d->lines_[l].contains(substring, Qt::CaseInsensitive) && substring != d->lines_[l])
-            return d->lines_[d->currentLine_ = l];
+    // Simple hack to avoid the seemingly-noop-on-first-history-iteration on disabled clear-on-hide
+    const auto match = [&](int l){ return d->matches(l, substring) && substring != d->lines[l]; };
+
+    if (const auto *c = d->candidates(substring); c)
+    {
+        for (auto it = lower_bound(c->rbegin(), c->rend(), d->current_line, greater<int>());
+             it != c->rend(); ++it)
+            if (*it < d->current_line && match(*it))
+                return d->lines[d->current_line = *it];
+    }
+    else
+        for (int l = d->current_line - 1; 0 <= l; --l)
+            if (match(l))
+                return d->lines[d->current_line = l];
+
     return QString{};
 }
 
 QString InputHistory::prev(const QString &substring)
 {
-    for (int l = d->currentLine_ + 1; l < (int)d->lines_.size(); ++l)
-        if (d->lines_[l].contains(substring, Qt::CaseInsensitive))
-            return d->lines_[d->currentLine_ = l];
+    if (const auto *c = d->candidates(substring); c)
+    {
+        for (auto it = upper_bound(c->begin(), c->end(), d->current_line); it != c->end(); ++it)
+            if (d->matches(*it, substring))
+                return d->lines[d->current_line = *it];
+    }
+    else
+        for (int l = d->current_line + 1; l < (int)d->lines.size(); ++l)
+            if (d->matches(l, substring))
+                return d->lines[d->current_line = l];
+
     return QString{};
 }
 
 void InputHistory::resetIterator()
 {
-    d->currentLine_ = (int)d->lines_.size();
+    d->current_line = (int)d->lines.size();
 }
@@ -1,38 +1,260 @@
 // Copyright (c) 2024 Manuel Schneider
 
+#include "datachanges.h"
 #include "frontend.h"
+#include "itemindex.h"
+#include "logging.h"
 #include "queryengine.h"
 #include "queryexecution.h"
+#include "queryexecutor.h"
 #include "session.h"
+#include "usagedatabase.h"
+#include "util.h"
+#include <QLoggingCategory>
+#include <QThreadPool>
+#include <algorithm>
 using namespace albert;
 using namespace std;
 
-Session::Session(QueryEngine &e, albert::Frontend &f) : engine_(e), frontend_(f)
+Q_DECLARE_LOGGING_CATEGORY(timeCat)
+
+static const char *CFG_SPECULATIONS = "speculativeQueries";
+static const uint  DEF_SPECULATIONS = 2;
+
+// Scheduled after regular queries
+static const int speculation_priority = -1;
+
+Session::Session(QueryEngine &e, albert::Frontend &f):
+    engine_(e),
+    frontend_(f),
+    generation_(0),
+    stale_(false),
+    speculation_count_(settings()->value(CFG_SPECULATIONS, DEF_SPECULATIONS).toUInt())
 {
     connect(&frontend_, &Frontend::inputChanged,
-            this, &Session::runQuery);
-    runQuery(frontend_.input());
+            this, &Session::onInputChanged);
+    connect(&frontend_, &Frontend::visibleChanged,
+            this, &Session::onVisibleChanged);
+
+    connect(&DataChanges::instance(), &DataChanges::changed,
+            this, &Session::onDataChanged, Qt::QueuedConnection);
+
+    runQuery(frontend_.input(), QueryExecutor::instance().now());
 }
 
 Session::~Session()
 {
     disconnect(&frontend_, &Frontend::inputChanged,
-               this, &Session::runQuery);
+               this, &Session::onInputChanged);
+    disconnect(&frontend_, &Frontend::visibleChanged,
+               this, &Session::onVisibleChanged);
+    disconnect(show_connection_);
     frontend_.setQuery(nullptr);
     if(!queries_.empty())
         queries_.back()->cancel();
     for (auto &q : queries_)
         q.release()->deleteLater();
+    for (auto &[_, q] : speculations_)
+    {
+        q->cancel();
+        q.release()->deleteLater();
+    }
+}
+
+void Session::invalidate()
+{
+    stale_ = true;
+    if (frontend_.isVisible())
+        refresh();
 }
 
-void Session::runQuery(const QString &query_string)
+uint64_t Session::dataGeneration() const
+{ return ItemIndex::generation() + UsageHistory::generation(); }
+
+void Session::onInputChanged(const QString &input)
+{
+    // The latency starts on input. Delays until the query is created are accounted.
+    runQuery(input, QueryExecutor::instance().now());
+}
+
+void Session::runQuery(const QString &query_string, QueryLatency::TimePoint input_time)
 {
     if(!queries_.empty())
         queries_.back()->cancel();
 
-    auto &q = queries_.emplace_back(engine_.query(query_string));
+    auto speculation = takeSpeculation(query_string);
+
+    // Data changes invalidate speculations as well
+    if (speculation && dataGeneration() != generation_)
+    {
+        queries_.emplace_back(::move(speculation));
+        queries_.back()->cancel();
+    }
+
+    generation_ = dataGeneration();
+    stale_ = false;
+
+    auto &q = queries_.emplace_back(speculation ? ::move(speculation) : engine_.query(query_string));
     q->setParent(this);  // important for qml ownership determination
+    connect(q.get(), &Query::finished, this, &Session::onQueryFinished);
 
     frontend_.setQuery(q.get());
-    q->run();
+
+    q->setInputTime(input_time);
+    if (!q->isSpeculative())
+        q->run();
+    else
+    {
+        DEBG << "Adopted speculative query:" << query_string;
+        q->setSpeculative(false);
+        if (q->isFinished())
+            QueryExecutor::instance().post(this, [this]{ speculate(); });
+    }
+
+    // Release superseded queries that are done. The session lives long.
+    for (auto it = queries_.begin(); it != prev(queries_.end());)
+        if ((*it)->isFinished())
+        {
+            it->release()->deleteLater();
+            it = queries_.erase(it);
+        }
+        else
+            ++it;
+}
+
+void Session::onDataChanged()
+{
+    // Visible results change on input only
+    if (!frontend_.isVisible())
+        refresh();
+}
+
+void Session::onQueryFinished()
+{
+    // Only for the current query, if it is not superseded meanwhile
+    if (queries_.empty() || sender() != queries_.back().get())
+        return;
+
+    // Changes arrived while the query was running
+    if (stale_ || (!frontend_.isVisible() && dataGeneration() != generation_))
+        refresh();
+    else
+        speculate();
+}
+
+void Session::refresh()
+{
+    // Rerun if the data changed, but do not interrupt a running query.
+    // Changes meanwhile are handled once it finished.
+    if ((stale_ || dataGeneration() != generation_)
+        && (queries_.empty() || queries_.back()->isFinished()))
+    {
+        DEBG << "Refreshing session query.";
+        runQuery(frontend_.input(), QueryExecutor::instance().now());
+    }
+}
+
+void Session::onVisibleChanged(bool visible)
+{
+    disconnect(show_connection_);
+
+    if (!visible)
+    {
+        // The rolling percentiles after each session, per-query lines are logged as they finish
+        if (timeCat().isDebugEnabled())
+            for (const auto &line : QueryLatency::report())
+                qCDebug(timeCat,).noquote() << line;
+
+        cancelSpeculations();  // Predicted for input that will not come
+        engine_.hidden();
+        refresh();  // Changes while visible
+        return;
+    }
+
+    engine_.aboutToShow();
+    show_time_ = QueryExecutor::instance().now();
+
+    // Changes not refreshed yet and results of handlers whose data is not tracked
+    if (stale_ || dataGeneration() != generation_ || !queries_.back()->isGenerationTracked())
+        runQuery(frontend_.input(), show_time_);
+
+    // Warm: Results are there, measure until the show has been processed.
+    // Cold: Measure until the query delivered its first results.
+    auto *q = queries_.back().get();
+    if (q->isFinished() || q->matches()->rowCount() > 0)
+        QueryExecutor::instance().post(this, [this]{ recordShowLatency(); });
+    else
+    {
+        show_connection_ = connect(q->matches(), &QAbstractItemModel::rowsInserted,
+                                   this, &Session::recordShowLatency);
+        connect(q, &Query::finished, this, [this, q]{
+            if (!queries_.empty() && queries_.back().get() == q)
+                recordShowLatency();
+        }, Qt::SingleShotConnection);
+    }
+}
+
+void Session::recordShowLatency()
+{
+    if (show_time_ == QueryLatency::TimePoint{})
+        return;
+
+    disconnect(show_connection_);
+    auto ms = chrono::duration<double, milli>(QueryExecutor::instance().now() - show_time_).count();
+    show_time_ = {};
+
+    QueryLatency::addShow(ms);
+    qCDebug(timeCat,).noquote() << QString("%1 ms show to populated").arg(ms, 6, 'f', 2);
+}
+
+unique_ptr<QueryExecution> Session::takeSpeculation(const QString &input)
+{
+    unique_ptr<QueryExecution> adopted;
+    if (auto it = ranges::find_if(speculations_, [&](const auto &s){ return s.first == input; });
+        it != speculations_.end())
+    {
+        adopted = ::move(it->second);
+        speculations_.erase(it);
+    }
+
+    // Real input arrived. Cancel the others immediately.
+    cancelSpeculations();
+
+    return adopted;
+}
+
+void Session::cancelSpeculations()
+{
+    for (auto &[_, q] : speculations_)
+    {
+        q->cancel();
+        queries_.emplace(queries_.begin(), ::move(q));  // Released once finished
+    }
+    speculations_.clear();
+}
+
+void Session::speculate()
+{
+    // Only for the current query, if it is not superseded meanwhile
+    if (!speculation_count_ || !frontend_.isVisible() || queries_.empty()
+        || (sender() && sender() != queries_.back().get())
+        || !queries_.back()->isValid() || !speculations_.empty())
+        return;
+
+    // Use idle workers only
+    auto *pool = QThreadPool::globalInstance();
+    const int idle = pool->maxThreadCount() - pool->activeThreadCount();
+    if (idle <= 0)
+        return;
+
+    const auto input = frontend_.input();
+    for (const auto &prediction :
+         UsageHistory::predictNext(input, min<uint>(speculation_count_, (uint)idle)))
+    {
+        auto q = engine_.query(prediction);
+        q->setParent(this);  // important for qml ownership determination
+        q->setSpeculative(true);
+        q->run(speculation_priority);
+        speculations_.emplace_back(prediction, ::move(q));
+    }
 }
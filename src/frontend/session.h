@@ -1,6 +1,7 @@
 // Copyright (c) 2024 Manuel Schneider
 
 #pragma once
+#include "querylatency.h"
 #include <QObject>
 #include <vector>
 #include <memory>
@@ -10,6 +11,16 @@ namespace albert {
 class Frontend;
 }
 
+///
+/// Runs the queries of the frontend.
+///
+/// Lives across show and hide. While hidden the query of the current input
+/// is rerun on data changes such that showing the frontend displays results
+/// instantly. Queries of handlers whose data is not tracked rerun on show.
+///
+/// While visible and idle the likely next inputs are queried speculatively.
+/// If the user types one of them its results are adopted.
+///
 class Session : public QObject
 {
     Q_OBJECT
@@ -19,14 +30,32 @@ public:
     Session(QueryEngine &engine, albert::Frontend &frontend);
     ~Session();
 
+    /// Marks the results stale, e.g. because handlers have been added.
+    void invalidate();
+
 private:
 
-    void runQuery(const QString &query);
-    void displayQuery();
+    void onInputChanged(const QString &input);
+    void runQuery(const QString &query, QueryLatency::TimePoint input_time);
+    void onVisibleChanged(bool visible);
+    void onDataChanged();
+    void onQueryFinished();
+    void refresh();
+    void recordShowLatency();
+    uint64_t dataGeneration() const;
+    void speculate();
+    std::unique_ptr<QueryExecution> takeSpeculation(const QString &input);
+    void cancelSpeculations();
 
     QueryEngine &engine_;
     albert::Frontend &frontend_;
     std::vector<std::unique_ptr<QueryExecution>> queries_;
+    std::vector<std::pair<QString, std::unique_ptr<QueryExecution>>> speculations_;
+    uint speculation_count_;
 
-};
+    uint64_t generation_;  // Data generation the current query has been run with
+    bool stale_;
+    QueryLatency::TimePoint show_time_;
+    QMetaObject::Connection show_connection_;
 
+};
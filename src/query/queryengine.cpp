@@ -98,6 +98,34 @@ unique_ptr<QueryExecution> QueryEngine::query(const QString &query_string)
     }
 }
 
+void QueryEngine::aboutToShow() const
+{
+    for (const auto &[id, h] : trigger_handlers_)
+        try {
+            h.handler->aboutToShow();
+        }
+        catch (const exception &e) {
+            WARN << QString("'%1' threw exception in aboutToShow:").arg(id) << e.what();
+        }
+        catch (...) {
+            WARN << QString("'%1' threw unknown exception in aboutToShow.").arg(id);
+        }
+}
+
+void QueryEngine::hidden() const
+{
+    for (const auto &[id, h] : trigger_handlers_)
+        try {
+            h.handler->hidden();
+        }
+        catch (const exception &e) {
+            WARN << QString("'%1' threw exception in hidden:").arg(id) << e.what();
+        }
+        catch (...) {
+            WARN << QString("'%1' threw unknown exception in hidden.").arg(id);
+        }
+}
+
 //
 // Trigger handlers
 //
@@ -22,6 +22,12 @@ public:
     
     std::unique_ptr<QueryExecution> query(const QString &query);
 
+    /// Notifies the trigger and global handlers that the frontend is about to show.
+    void aboutToShow() const;
+
+    /// Notifies the trigger and global handlers that the frontend has been hidden.
+    void hidden() const;
+
     std::map<QString, albert::TriggerQueryHandler*> triggerHandlers();
     std::map<QString, albert::GlobalQueryHandler*> globalHandlers();
     std::map<QString, albert::FallbackHandler*> fallbackHandlers();
@@ -1,24 +1,63 @@
 // Copyright (c) 2022-2024 Manuel Schneider
 
+#include "federatedindex.h"
+#include "indexqueryhandler.h"
 #include "logging.h"
+#include "perfcounters.h"
 #include "queryengine.h"
 #include "queryexecution.h"
+#include "queryexecutor.h"
 #include "usagedatabase.h"
-#include <QtConcurrent>
+#include <QCoreApplication>
 using namespace albert;
 using namespace std::chrono;
 using namespace std;
 
 Q_LOGGING_CATEGORY(timeCat, "albert.query_runtimes")
 
+// Counting costs some syscalls per handler invocation. Count only if the timings are logged.
+static bool countersEnabled()
+{ return timeCat().isDebugEnabled() && PerfCounters::threadInstance().isAvailable(); }
+
 uint QueryExecution::query_count = 0;
 
+namespace
+{
+
+// Runs a function when going out of scope
+template<class F>
+struct ScopeExit
+{
+    F f;
+    ~ScopeExit() { f(); }
+};
+
+template<class F>
+ScopeExit(F) -> ScopeExit<F>;
+
+// Exceptions must not escape into the executor
+void runCatching(const QueryExecutor::Task &task, uint query_id)
+{
+    try {
+        task();
+    }
+    catch (const exception &e) {
+        WARN << QString("Task of query #%1 threw exception:\n").arg(query_id) << e.what();
+    }
+    catch (...) {
+        WARN << QString("Task of query #%1 threw unknown exception.").arg(query_id);
+    }
+}
+
+}
+
 QueryExecution::QueryExecution(QueryEngine *e,
                                vector<FallbackHandler *> &&fallback_handlers,
                                TriggerQueryHandler *query_handler,
                                QString string,
                                QString trigger):
     query_engine_(e),
+    executor_(QueryExecutor::instance()),
     query_id(query_count++),
     trigger_(::move(trigger)),
     string_(::move(string)),
@@ -28,35 +67,52 @@ QueryExecution::QueryExecution(QueryEngine *e,
     matches_(this),  // Important for qml ownership determination
     fallbacks_(this)  // Important for qml ownership determination
 {
-    connect(&future_watcher_, &decltype(future_watcher_)::finished, this, &Query::finished);
+    latency_.input = executor_.now();
 }
 
 QueryExecution::~QueryExecution()
 {
     // Wait in derived class otherwise query is partially destroyed while handlers are still running
+    cancelAndWait();
+    DEBG << QString("Query deleted. [#%1 '%2']").arg(query_id).arg(string());
+}
+
+void QueryExecution::cancelAndWait()
+{
     cancel();
-    if (!isFinished()) {
+    if (!future_.isFinished()) {
         WARN << QString("Busy wait on query: #%1").arg(query_id);
         // there may be some queued collectResults calls
         QCoreApplication::processEvents();
-        future_watcher_.waitForFinished();
+        executor_.wait(future_);
     }
-    DEBG << QString("Query deleted. [#%1 '%2']").arg(query_id).arg(string());
 }
 
-void QueryExecution::run()
+void QueryExecution::run(int priority)
 {
-    future_watcher_.setFuture(QtConcurrent::run([this](){
+    priority_ = priority;
+    promise_.reportStarted();
+    future_ = promise_.future();
+
+    unique_lock lock(tasks_mutex_);
+    ++pending_tasks_;
+    tasks_.emplace_back(executor_.run([this]{
+        latency_.dispatched = executor_.now();
         try {
             runFallbackHandlers();
+            const bool count = countersEnabled();
+            if (count)
+                PerfCounters::threadInstance().start();
             auto tp = system_clock::now();
             query_handler_->handleTriggerQuery(this);
+            auto d = duration_cast<milliseconds>(system_clock::now() - tp).count();
+            auto counters = count ? PerfCounters::threadInstance().stop() : PerfCounters::Sample{};
             qCDebug(timeCat,).noquote()
-                << QStringLiteral("\x1b[38;5;33m│%1 ms│ TRIGGER |%2│ #%3  '%4' '%5' \x1b[0m")
-                       .arg(duration_cast<milliseconds>(system_clock::now() - tp).count(), 6)
+                << QStringLiteral("\x1b[38;5;33m│%1 ms│ TRIGGER |%2│ #%3  '%4' '%5' %6\x1b[0m")
+                       .arg(d, 6)
                        .arg(matches_.rowCount(), 6)
                        .arg(query_id)
-                       .arg(trigger_, string_);
+                       .arg(trigger_, string_, counters.toString());
         }
         catch (const exception &e) {
             WARN << QString("TriggerQueryHandler '%1' threw exception:\n").arg(query_handler_->id()) << e.what();
@@ -64,10 +120,71 @@ void QueryExecution::run()
         catch (...){
             CRIT << "Unexpected exception in QueryExecution::run()!";
         }
-    }));
+        release();
+    }, priority));
 }
 
-void QueryExecution::cancel() { valid_ = false; }
+void QueryExecution::spawn(QueryExecutor::Task task)
+{
+    unique_lock lock(tasks_mutex_);
+    if (!valid_)
+        return;
+
+    ++pending_tasks_;
+    tasks_.emplace_back(executor_.run([this, t = ::move(task)]{
+        ScopeExit release_task{[this]{ release(); }};
+        runCatching(t, query_id);
+    }, priority_));
+}
+
+void QueryExecution::release()
+{
+    if (--pending_tasks_ == 0)
+    {
+        executor_.post(this, [this]{
+            finished_ = true;
+            onFinished();
+            emit finished();
+        });
+
+        // Finishing may unblock the destructor. The copy keeps the shared
+        // state alive until reportFinished returned. Do not touch this anymore.
+        auto promise = promise_;
+        promise.reportFinished();
+    }
+}
+
+void QueryExecution::cancel()
+{
+    valid_ = false;
+
+    // Drop the tasks not started yet
+    unique_lock lock(tasks_mutex_);
+    for (auto id : tasks_)
+        if (executor_.cancel(id))
+            release();
+    tasks_.clear();
+}
+
+void QueryExecution::setInputTime(QueryLatency::TimePoint time) { latency_.input = time; }
+
+void QueryExecution::setSpeculative(bool speculative)
+{
+    // Adopted by the input. Stages done before took no time for the user.
+    if (speculative_ && !speculative)
+    {
+        speculative_ = false;
+        if (finished_ && valid_)
+            recordLatency();
+    }
+    else
+        speculative_ = speculative;
+}
+
+bool QueryExecution::isSpeculative() const { return speculative_; }
+
+bool QueryExecution::isGenerationTracked() const
+{ return dynamic_cast<IndexQueryHandler*>(query_handler_); }
 
 QString QueryExecution::trigger() const { return trigger_; }
 
@@ -77,7 +194,7 @@ QString QueryExecution::synopsis() const { return query_handler_->synopsis(); }
 
 const bool &QueryExecution::isValid() const { return valid_; }
 
-bool QueryExecution::isFinished() const { return future_watcher_.isFinished(); }
+bool QueryExecution::isFinished() const { return finished_; }
 
 bool QueryExecution::isTriggered() const { return !trigger().isEmpty(); }
 
@@ -133,12 +250,12 @@ void QueryExecution::add(vector<shared_ptr<Item>> &&items)
 
 void QueryExecution::invokeCollectResults()
 {
-    QMetaObject::invokeMethod(this, &QueryExecution::collectResults, Qt::QueuedConnection);
+    executor_.post(this, [this]{ collectResults(); });
 }
 
 void QueryExecution::runFallbackHandlers()
 {
-    if (trigger_.isEmpty() && string_.isEmpty())
+    if (fallback_handlers_.empty() || (trigger_.isEmpty() && string_.isEmpty()))
         return;
 
     const auto &o = query_engine_->fallbackOrder();
@@ -168,9 +285,41 @@ void QueryExecution::collectResults()
     {
         matches_.add(results_buffer_.begin(), results_buffer_.end());
         results_buffer_.clear();
+
+        if (latency_.first_results == QueryLatency::TimePoint{})
+            latency_.first_results = executor_.now();
     }
 }
 
+void QueryExecution::onFinished()
+{
+    latency_.finished = executor_.now();
+
+    // Cancelled and speculative queries would skew the statistics
+    if (valid_ && !speculative_)
+        recordLatency();
+}
+
+void QueryExecution::recordLatency()
+{
+    QueryLatency::add(latency_);
+
+    auto ms = [this](QueryLatency::TimePoint stage){
+        auto d = QueryLatency::msSinceInput(latency_, stage);
+        return d < 0. ? QStringLiteral("     -") : QString("%1").arg(d, 6, 'f', 1);
+    };
+
+    qCDebug(timeCat,).noquote()
+        << QStringLiteral("\x1b[38;5;33m│ Dispatch│    First│    Top-K│ Finished│\x1b[0m");
+
+    qCDebug(timeCat,).noquote()
+        << QStringLiteral("\x1b[38;5;33m│%1 ms│%2 ms│%3 ms│%4 ms│ #%5 LATENCY '%6%7'\x1b[0m")
+               .arg(ms(latency_.dispatched), ms(latency_.first_results),
+                    ms(latency_.top_k), ms(latency_.finished))
+               .arg(query_id)
+               .arg(trigger_, string_);
+}
+
 // ////////////////////////////////////////////////////////////////////////////
 
 GlobalQuery::GlobalQuery(QueryEngine *e,
@@ -182,17 +331,17 @@ GlobalQuery::GlobalQuery(QueryEngine *e,
 {
 }
 
-// GlobalQuery::~GlobalQuery()
-// {
-//     // Wait in derived class otherwise query is partially destroyed while handlers are still running
-//     cancel();
-//     if (!isFinished()) {
-//         WARN << QString("Busy wait on query: #%1").arg(query_id);
-//         future_watcher_.waitForFinished();
-//     }
-//     DEBG << QString("Query deleted. [#%1 '%2']").arg(query_id).arg(string_);
-// }
+GlobalQuery::~GlobalQuery()
+{
+    // Wait here otherwise query is partially destroyed while handlers are still running
+    cancelAndWait();
+}
 
+bool GlobalQuery::isGenerationTracked() const
+{
+    return ranges::all_of(query_handlers_, [](auto *h){
+        return dynamic_cast<IndexQueryHandler*>(h) != nullptr; });
+}
 
 QString GlobalQuery::id() const
 { return QStringLiteral("globalquery"); }
@@ -205,70 +354,164 @@ QString GlobalQuery::description() const
 
 void GlobalQuery::handleTriggerQuery(albert::Query *)
 {
-    mutex rank_items_mutex;  // 6.4 Still no move semantics in QtConcurrent
-    vector<pair<Extension*,RankItem>> rank_items;
-
-
     qCDebug(timeCat,).noquote() << QStringLiteral("\x1b[38;5;244m│ Handling│  Scoring│ Count│\x1b[0m");
 
-    function<void(GlobalQueryHandler*)> map = [this, &rank_items_mutex, &rank_items](GlobalQueryHandler *handler)
-    {
-        // blocking map is not interruptible. end cancelled runs fast.
-        if (!isValid())
-            return;
+    // Federated handlers are searched in a single pass per federated index
+    vector<QueryExecutor::Task> tasks;
+    for (auto *handler : query_handlers_)
+        if (auto *h = dynamic_cast<IndexQueryHandler*>(handler);
+            h && h->isFederated() && !string_.isEmpty())
+            federated_handlers_.insert(handler);
+        else
+            tasks.emplace_back([this, handler]{ handle(handler); });
+
+    for (bool fuzzy : {false, true})
+        if (ranges::any_of(federated_handlers_, [&](auto *h){
+                return FederatedIndex::instance(fuzzy).contains(h); }))
+            tasks.emplace_back([this, fuzzy]{ searchFederated(fuzzy); });
+
+    // A task per handler. The last one to return merges the results.
+    // Pending tasks of cancelled queries are dropped without being run.
+    handling_start_ = system_clock::now();
+    remaining_tasks_ = tasks.size();
+    if (tasks.empty())
+        merge();
+    else
+        for (auto &task : tasks)
+            spawn([this, t = ::move(task)]{
+                // The last task to return merges, also if others threw
+                ScopeExit merge_last{[this]{
+                    if (--remaining_tasks_ == 0)
+                        merge();
+                }};
+                runCatching(t, query_id);
+            });
+}
 
-        try {
-            auto t = system_clock::now();
+void GlobalQuery::handle(GlobalQueryHandler *handler)
+{
+    if (!isValid())
+        return;
 
-            vector<RankItem> results;
-            if (string_.isEmpty())
-                for (auto &item : handler->handleEmptyQuery(this))
-                    results.emplace_back(::move(item), 0);
-            else
-                results = handler->handleGlobalQuery(this);
+    try {
+        const bool count = countersEnabled();
+        if (count)
+            PerfCounters::threadInstance().start();
+
+        auto t = system_clock::now();
+
+        // Index query handlers opting in are matched on their index snapshot
+        vector<RankItem> results;
+        shared_ptr<const ItemIndex> index;
+        vector<ItemIndex::Match> matches;
+        uint limit = 0;
+        if (string_.isEmpty())
+            for (auto &item : handler->handleEmptyQuery(this))
+                results.emplace_back(::move(item), 0);
+        else if (auto *h = dynamic_cast<IndexQueryHandler*>(handler);
+                 h && (index = h->globalQueryIndex(limit)))
+            matches = index->match(string_, isValid(), limit);
+        else
+            results = handler->handleGlobalQuery(this);
+
+        auto d_h = duration_cast<milliseconds>(system_clock::now()-t).count();
 
-            auto d_h = duration_cast<milliseconds>(system_clock::now()-t).count();
+        auto counters = count ? PerfCounters::threadInstance().stop() : PerfCounters::Sample{};
 
-            t = system_clock::now();
+        t = system_clock::now();
+        if (index)
+            UsageHistory::applyScores(handler->id(), *index, matches);
+        else
             handler->applyUsageScore(&results);
-            auto d_s = duration_cast<milliseconds>(system_clock::now()-t).count();
+        auto d_s = duration_cast<milliseconds>(system_clock::now()-t).count();
 
-            // makes no sense to time this, since waiting for unlock
-            unique_lock lock(rank_items_mutex);
-            rank_items.reserve(rank_items.size() + results.size());
-            for (auto &rank_item : results)
-                rank_items.emplace_back(handler, ::move(rank_item));
+        const auto result_count = index ? matches.size() : results.size();
 
-            qCDebug(timeCat,).noquote()
-                << QStringLiteral("\x1b[38;5;244m│%1 ms│%2 ms│%3│ #%4 '%5' %6\x1b[0m")
-                       .arg(d_h, 6)
-                       .arg(d_s, 6)
-                       .arg(results.size(), 6)
-                       .arg(query_id)
-                       .arg(string_, handler->id());
-        }
-        catch (const exception &e) {
-            WARN << QString("GlobalQueryHandler '%1' threw exception:\n").arg(handler->id()) << e.what();
-        }
-        catch (...) {
-            WARN << QString("GlobalQueryHandler '%1' threw unknown exception:\n").arg(handler->id());
-        }
-    };
+        // makes no sense to time this, since waiting for unlock
+        unique_lock lock(ranking_mutex_);
+        const auto source = (uint32_t)sources_.size();
+        ranking_.reserve(ranking_.size() + result_count);
+        if (index)
+            for (const auto &[slot, score] : matches)
+                ranking_.push_back({score, slot, source});
+        else
+            for (uint32_t slot = 0; slot < result_count; ++slot)
+                ranking_.push_back({results[slot].score, slot, source});
+        sources_.push_back({handler, ::move(results), ::move(index), {}});
+
+        qCDebug(timeCat,).noquote()
+            << QStringLiteral("\x1b[38;5;244m│%1 ms│%2 ms│%3│ #%4 '%5' %6 %7\x1b[0m")
+                   .arg(d_h, 6)
+                   .arg(d_s, 6)
+                   .arg(result_count, 6)
+                   .arg(query_id)
+                   .arg(string_, handler->id(), counters.toString());
+    }
+    catch (const exception &e) {
+        WARN << QString("GlobalQueryHandler '%1' threw exception:\n").arg(handler->id()) << e.what();
+    }
+    catch (...) {
+        WARN << QString("GlobalQueryHandler '%1' threw unknown exception:\n").arg(handler->id());
+    }
+}
 
-    auto tp = system_clock::now();
-    QtConcurrent::blockingMap(query_handlers_, map);
-    auto d_h = duration_cast<milliseconds>(system_clock::now()-tp).count();
+void GlobalQuery::searchFederated(bool fuzzy)
+{
+    if (!isValid())
+        return;
+
+    auto t = system_clock::now();
+
+    auto results = FederatedIndex::instance(fuzzy).match(string_, isValid());
+    erase_if(results.matches, [&](const auto &m){  // Disabled handlers may contribute
+        return !federated_handlers_.contains(results.owner(m.slot)); });
+
+    auto d_f = duration_cast<milliseconds>(system_clock::now()-t).count();
+
+    t = system_clock::now();
+    UsageHistory::applyScores(results.index(),
+                              [&](uint32_t slot){ return results.owner(slot); },
+                              results.matches);
+    auto d_s = duration_cast<milliseconds>(system_clock::now()-t).count();
+
+    const auto count = results.matches.size();
+
+    unique_lock lock(ranking_mutex_);
+    const auto source = (uint32_t)sources_.size();
+    ranking_.reserve(ranking_.size() + count);
+    for (const auto &[slot, score] : results.matches)
+        ranking_.push_back({score, slot, source});
+    results.matches = {};  // Keep the snapshot only
+    sources_.push_back({nullptr, {}, {}, ::move(results)});
+
+    qCDebug(timeCat,).noquote()
+        << QStringLiteral("\x1b[38;5;244m│%1 ms│%2 ms│%3│ #%4 '%5' federated (fuzzy: %6)\x1b[0m")
+               .arg(d_f, 6)
+               .arg(d_s, 6)
+               .arg(count, 6)
+               .arg(query_id)
+               .arg(string_)
+               .arg(fuzzy);
+}
+
+void GlobalQuery::merge()
+{
+    if (!isValid())
+        return;
+
+    auto d_h = duration_cast<milliseconds>(system_clock::now()-handling_start_).count();
 
-    static const auto cmp = [](const auto &a, const auto &b){
-        if (a.second.score == b.second.score)
-            return a.second.item->text() > b.second.item->text();
+    const auto cmp = [this](const Match &a, const Match &b){
+        if (a.score == b.score)
+            return item(a).text() > item(b).text();
         else
-            return a.second.score > b.second.score;
+            return a.score > b.score;
     };
 
-    tp = system_clock::now();
-    auto begin = ::begin(rank_items);
-    auto end = ::end(rank_items);
+    // All handler tasks returned. No need to lock.
+    auto tp = system_clock::now();
+    auto begin = ::begin(ranking_);
+    auto end = ::end(ranking_);
     auto mid = begin + 20;
 
     // Partially sort the visible items for fast response times
@@ -276,12 +519,16 @@ void GlobalQuery::handleTriggerQuery(albert::Query *)
     {
         partial_sort(begin, mid, end, cmp);
         addRankItems(begin, mid);
+        latency_.top_k = executor_.now();
         begin = mid;
     }
 
     sort(begin, end, cmp);
     addRankItems(begin, end);
 
+    if (latency_.top_k == QueryLatency::TimePoint{})
+        latency_.top_k = executor_.now();
+
     auto d_s = duration_cast<milliseconds>(system_clock::now()-tp).count();
 
     qCDebug(timeCat,).noquote() << QStringLiteral("\x1b[38;5;33m│ Handling│  Sorting│ Count│\x1b[0m");
@@ -290,18 +537,36 @@ void GlobalQuery::handleTriggerQuery(albert::Query *)
         << QStringLiteral("\x1b[38;5;33m│%1 ms│%2 ms│%3│ #%4 GLOBAL '%5'\x1b[0m")
                .arg(d_h, 6)
                .arg(d_s, 6)
-               .arg(rank_items.size(), 6)
+               .arg(ranking_.size(), 6)
                .arg(query_id)
                .arg(string_);
 }
 
-void GlobalQuery::addRankItems(vector<pair<Extension*,RankItem>>::iterator begin,
-                               vector<pair<Extension*,RankItem>>::iterator end)
+const Item &GlobalQuery::item(const Match &match) const
+{
+    const auto &source = sources_[match.source];
+    if (!source.handler)
+        return *source.federated.item(match.slot);
+    else if (source.index)
+        return *source.index->item(match.slot);
+    else
+        return *source.rank_items[match.slot].item;
+}
+
+void GlobalQuery::addRankItems(vector<Match>::iterator begin, vector<Match>::iterator end)
 {
     unique_lock lock(results_buffer_mutex_);
 
+    // Materialize the delivered items only
     for (auto it = begin; it < end; ++it)
-        results_buffer_.emplace_back(it->first, ::move(it->second.item));
+        if (auto &source = sources_[it->source]; !source.handler)
+            results_buffer_.emplace_back(source.federated.owner(it->slot),
+                                         source.federated.item(it->slot));
+        else if (source.index)
+            results_buffer_.emplace_back(source.handler, source.index->item(it->slot));
+        else
+            results_buffer_.emplace_back(source.handler,
+                                         ::move(source.rank_items[it->slot].item));
 
     if (valid_)
         invokeCollectResults();
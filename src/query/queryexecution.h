@@ -2,11 +2,17 @@
 
 #pragma once
 #include "fallbackhandler.h"
+#include "federatedindex.h"
 #include "globalqueryhandler.h"
 #include "itemsmodel.h"
 #include "query.h"
+#include "queryexecutor.h"
+#include "querylatency.h"
 #include "triggerqueryhandler.h"
-#include <QFutureWatcher>
+#include <QFuture>
+#include <QFutureInterface>
+#include <atomic>
+#include <unordered_set>
 namespace albert { class Item; }
 class QueryEngine;
 
@@ -27,9 +33,23 @@ public:
                    QString trigger);
     ~QueryExecution();
 
-    void run();
+    /// Runs the query. Higher priorities are scheduled first.
+    void run(int priority = 0);
     void cancel();
 
+    /// The time the input of the query was received, the start of its
+    /// latency. Defaults to the construction.
+    void setInputTime(QueryLatency::TimePoint);
+
+    /// Speculative queries are not accounted in the latency statistics.
+    /// Once adopted they are, relative to the input time. Set it before.
+    void setSpeculative(bool);
+    bool isSpeculative() const;
+
+    /// True if the results change with the data generations only, i.e. all
+    /// handlers are index query handlers. Fallbacks depend on the string only.
+    virtual bool isGenerationTracked() const;
+
     QString trigger() const override final;
     QString string() const override final;
     QString synopsis() const override final;
@@ -50,11 +70,22 @@ public:
 
 protected:
 
+    /// Runs task on a worker as part of this query. The query finishes once
+    /// all of its tasks returned. cancel() drops the tasks not started yet.
+    void spawn(QueryExecutor::Task task);
+
+    /// Cancels and blocks until running tasks returned. Call it in the
+    /// destructor of derived classes whose members are used by tasks.
+    void cancelAndWait();
+
     void runFallbackHandlers();
     void invokeCollectResults();
     Q_INVOKABLE void collectResults();
+    void onFinished();
+    void recordLatency();
 
     QueryEngine *query_engine_;
+    QueryExecutor &executor_;
     static uint query_count;
     const uint query_id;
 
@@ -65,8 +96,18 @@ protected:
     const std::vector<albert::FallbackHandler*> fallback_handlers_;
 
     bool valid_ = true;
+    bool speculative_ = false;
+    bool finished_ = false;
+
+    int priority_ = 0;
+    std::atomic<uint> pending_tasks_ = 0;
+    std::vector<QueryExecutor::TaskId> tasks_;
+    std::mutex tasks_mutex_;
+    QFutureInterface<void> promise_;  // Shared state, outlives this while finishing
+    QFuture<void> future_;
 
-    QFutureWatcher<void> future_watcher_;
+    // Each stage is written by a single thread. Read when finished.
+    QueryLatency::Timestamps latency_;
 
     // Mutable because global query handler needs adds items in handleTriggerQuery(…) _const_
     mutable std::vector<std::pair<albert::Extension*, std::shared_ptr<albert::Item>>> results_buffer_;
@@ -74,6 +115,8 @@ protected:
 
 private:
 
+    void release();
+
     ItemsModel matches_;
     ItemsModel fallbacks_;
 
@@ -91,17 +134,45 @@ public:
                 std::vector<albert::FallbackHandler*> &&fallback_handlers,
                 std::vector<albert::GlobalQueryHandler*> &&query_handlers,
                 QString string);
+    ~GlobalQuery();
 
     QString id() const override;
     QString name() const override;
     QString description() const override;
     void handleTriggerQuery(albert::Query *) override;
+    bool isGenerationTracked() const override;
 
 private:
 
-    void addRankItems(std::vector<std::pair<albert::Extension*,albert::RankItem>>::iterator begin,
-                      std::vector<std::pair<albert::Extension*,albert::RankItem>>::iterator end);
+    // Ranking works on handles. Item shared_ptrs are touched only to deliver
+    // the results to the model.
+    struct Match
+    {
+        double score;
+        uint32_t slot;    // Of the item in its source
+        uint32_t source;  // Index in sources_
+    };
+
+    struct Source
+    {
+        albert::Extension *handler;                     // Results of handler, in
+        std::vector<albert::RankItem> rank_items;       // its rank items or
+        std::shared_ptr<const albert::ItemIndex> index;  // its index, or
+        FederatedIndex::Results federated;              // of a federated index
+    };
+
+    void handle(albert::GlobalQueryHandler *handler);
+    void searchFederated(bool fuzzy);
+    void merge();
+    const albert::Item &item(const Match &match) const;
+    void addRankItems(std::vector<Match>::iterator begin, std::vector<Match>::iterator end);
 
     std::vector<albert::GlobalQueryHandler*> query_handlers_;
+    std::unordered_set<const albert::GlobalQueryHandler*> federated_handlers_;
+    std::vector<Source> sources_;
+    std::vector<Match> ranking_;
+    std::mutex ranking_mutex_;
+    std::atomic<size_t> remaining_tasks_;
+    std::chrono::system_clock::time_point handling_start_;
 
 };
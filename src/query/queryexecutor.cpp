@@ -0,0 +1,73 @@
+// Copyright (c) 2024 Manuel Schneider
+
+#include "queryexecutor.h"
+#include <QObject>
+#include <QRunnable>
+#include <QThreadPool>
+#include <mutex>
+#include <unordered_map>
+using namespace std;
+
+namespace
+{
+
+class ThreadPoolExecutor : public QueryExecutor
+{
+public:
+
+    QueryLatency::TimePoint now() const override
+    { return QueryLatency::Clock::now(); }
+
+    TaskId run(Task task, int priority) override
+    {
+        unique_lock lock(mutex_);
+        const auto id = next_id_++;
+        auto *runnable = QRunnable::create([this, id, t = ::move(task)]{
+            {
+                unique_lock l(mutex_);
+                pending_.erase(id);  // Started. Not cancellable anymore.
+            }
+            t();
+        });
+        pending_.emplace(id, runnable);
+        QThreadPool::globalInstance()->start(runnable, priority);
+        return id;
+    }
+
+    bool cancel(TaskId id) override
+    {
+        unique_lock lock(mutex_);
+        if (auto it = pending_.find(id);
+            it != pending_.end() && QThreadPool::globalInstance()->tryTake(it->second))
+        {
+            delete it->second;  // Taken runnables are owned by the caller
+            pending_.erase(it);
+            return true;
+        }
+        return false;
+    }
+
+    void post(QObject *context, Task task) override
+    { QMetaObject::invokeMethod(context, ::move(task), Qt::QueuedConnection); }
+
+    void wait(QFuture<void> &future) override
+    { future.waitForFinished(); }
+
+private:
+
+    mutex mutex_;
+    TaskId next_id_ = 0;
+    unordered_map<TaskId, QRunnable*> pending_;
+
+};
+
+ThreadPoolExecutor default_executor;
+QueryExecutor *executor = &default_executor;
+
+}
+
+QueryExecutor::~QueryExecutor() = default;
+
+QueryExecutor &QueryExecutor::instance() { return *executor; }
+
+void QueryExecutor::setInstance(QueryExecutor *e) { executor = e ? e : &default_executor; }
@@ -0,0 +1,50 @@
+// Copyright (c) 2024 Manuel Schneider
+
+#pragma once
+#include "querylatency.h"
+#include <QFuture>
+#include <functional>
+class QObject;
+
+///
+/// Schedules the work of query executions.
+///
+/// Queries do not use thread pools, event loops or clocks directly but the
+/// executor. The default executor runs tasks on the global thread pool and
+/// delivers to the main thread using the event loop. Tests install a
+/// deterministic executor with a virtual clock.
+///
+class QueryExecutor
+{
+public:
+
+    using Task = std::function<void()>;
+    using TaskId = quint64;
+
+    virtual ~QueryExecutor();
+
+    /// The time of latency measurements.
+    virtual QueryLatency::TimePoint now() const = 0;
+
+    /// Runs task on a worker thread. Higher priorities are scheduled first.
+    virtual TaskId run(Task task, int priority) = 0;
+
+    /// Removes the task if it did not start yet.
+    /// Returns true if the task has been removed and will never run.
+    virtual bool cancel(TaskId task) = 0;
+
+    /// Calls task in the thread of context some time later, unless context has
+    /// been destroyed meanwhile.
+    virtual void post(QObject *context, Task task) = 0;
+
+    /// Blocks until future finished.
+    virtual void wait(QFuture<void> &future) = 0;
+
+    /// The executor in use.
+    static QueryExecutor &instance();
+
+    /// Replaces the executor. Pass nullptr to restore the default.
+    /// Not thread safe. Set it before any query is created.
+    static void setInstance(QueryExecutor *executor);
+
+};
@@ -0,0 +1,102 @@
+// Copyright (c) 2024 Manuel Schneider
+
+#include "querylatency.h"
+#include <QString>
+#include <algorithm>
+#include <cmath>
+using namespace std::chrono;
+using namespace std;
+
+RollingPercentiles::RollingPercentiles(size_t capacity):
+    capacity_(max<size_t>(capacity, 1)),
+    next_(0)
+{
+    samples_.reserve(capacity_);
+}
+
+void RollingPercentiles::add(double sample)
+{
+    if (samples_.size() < capacity_)
+        samples_.emplace_back(sample);
+    else
+        samples_[next_] = sample;
+    next_ = (next_ + 1) % capacity_;
+}
+
+double RollingPercentiles::percentile(double p) const
+{
+    if (samples_.empty())
+        return 0.;
+
+    auto rank = (size_t)ceil(clamp(p, 0., 100.) / 100. * (double)samples_.size());
+    auto nth = rank == 0 ? 0 : rank - 1;
+
+    auto sorted = samples_;
+    nth_element(sorted.begin(), sorted.begin() + (long)nth, sorted.end());
+    return sorted[nth];
+}
+
+size_t RollingPercentiles::size() const { return samples_.size(); }
+
+
+mutex QueryLatency::mutex_;
+RollingPercentiles QueryLatency::dispatched_;
+RollingPercentiles QueryLatency::first_results_;
+RollingPercentiles QueryLatency::top_k_;
+RollingPercentiles QueryLatency::finished_;
+RollingPercentiles QueryLatency::show_;
+
+double QueryLatency::msSinceInput(const Timestamps &t, TimePoint stage)
+{
+    if (t.input == TimePoint{} || stage == TimePoint{})
+        return -1.;
+    return max(duration<double, milli>(stage - t.input).count(), 0.);
+}
+
+void QueryLatency::add(const Timestamps &t)
+{
+    unique_lock lock(mutex_);
+    for (auto &[stage, stats] : {
+             pair<TimePoint, RollingPercentiles*>{t.dispatched, &dispatched_},
+             pair<TimePoint, RollingPercentiles*>{t.first_results, &first_results_},
+             pair<TimePoint, RollingPercentiles*>{t.top_k, &top_k_},
+             pair<TimePoint, RollingPercentiles*>{t.finished, &finished_}
+         })
+        if (auto ms = msSinceInput(t, stage); ms >= 0.)
+            stats->add(ms);
+}
+
+void QueryLatency::addShow(double ms)
+{
+    unique_lock lock(mutex_);
+    show_.add(ms);
+}
+
+QStringList QueryLatency::report()
+{
+    unique_lock lock(mutex_);
+
+    QStringList sl;
+    sl << QStringLiteral("%1│%2│%3│%4│%5")
+              .arg(QStringLiteral("Stage"), -14)
+              .arg(QStringLiteral("p50 ms"), 9)
+              .arg(QStringLiteral("p95 ms"), 9)
+              .arg(QStringLiteral("p99 ms"), 9)
+              .arg(QStringLiteral("Samples"), 8);
+
+    for (auto &[name, stats] : {
+             pair<const char*, const RollingPercentiles*>{"Dispatched", &dispatched_},
+             pair<const char*, const RollingPercentiles*>{"First results", &first_results_},
+             pair<const char*, const RollingPercentiles*>{"Top-K final", &top_k_},
+             pair<const char*, const RollingPercentiles*>{"Finished", &finished_},
+             pair<const char*, const RollingPercentiles*>{"Show", &show_}
+         })
+        sl << QStringLiteral("%1│%2│%3│%4│%5")
+                  .arg(QString::fromLatin1(name), -14)
+                  .arg(stats->percentile(50), 9, 'f', 2)
+                  .arg(stats->percentile(95), 9, 'f', 2)
+                  .arg(stats->percentile(99), 9, 'f', 2)
+                  .arg(stats->size(), 8);
+
+    return sl;
+}
@@ -0,0 +1,78 @@
+// Copyright (c) 2024 Manuel Schneider
+
+#pragma once
+#include <QStringList>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+///
+/// Fixed size window of samples providing nearest-rank percentiles.
+///
+class RollingPercentiles
+{
+public:
+
+    RollingPercentiles(size_t capacity = 1000);
+
+    void add(double sample);
+
+    /// Nearest-rank percentile of the samples in the window. p in [0, 100].
+    /// Returns 0 if there are no samples.
+    double percentile(double p) const;
+
+    size_t size() const;
+
+private:
+
+    std::vector<double> samples_;
+    size_t capacity_;
+    size_t next_;
+
+};
+
+
+///
+/// End-to-end latency statistics of query executions.
+///
+/// All stages are relative to the time the input has been received.
+///
+class QueryLatency
+{
+public:
+
+    using Clock = std::chrono::steady_clock;
+    using TimePoint = Clock::time_point;
+
+    /// Stage timestamps of a single query execution. Unset stages are default constructed.
+    struct Timestamps
+    {
+        TimePoint input;          ///< Frontend input received
+        TimePoint dispatched;     ///< Handler started on the worker thread
+        TimePoint first_results;  ///< First rows inserted into the matches model
+        TimePoint top_k;          ///< Visible top results final (global queries only)
+        TimePoint finished;       ///< Query finished
+    };
+
+    /// Adds the samples of a finished query to the rolling statistics.
+    static void add(const Timestamps &timestamps);
+
+    /// Adds a sample of the time from show request to populated window.
+    static void addShow(double ms);
+
+    /// Percentiles of all stages, formatted for the debug log and the RPC.
+    static QStringList report();
+
+    /// Milliseconds from input to the given stage or a negative value if unset.
+    static double msSinceInput(const Timestamps &timestamps, TimePoint stage);
+
+private:
+
+    static std::mutex mutex_;
+    static RollingPercentiles dispatched_;
+    static RollingPercentiles first_results_;
+    static RollingPercentiles top_k_;
+    static RollingPercentiles finished_;
+    static RollingPercentiles show_;
+
+};
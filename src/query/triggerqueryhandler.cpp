@@ -16,3 +16,7 @@ void TriggerQueryHandler::setTrigger(const QString &) {}
 bool TriggerQueryHandler::supportsFuzzyMatching() const { return false; }
 
 void TriggerQueryHandler::setFuzzyMatching(bool) { }
+
+void TriggerQueryHandler::aboutToShow() {}
+
+void TriggerQueryHandler::hidden() {}
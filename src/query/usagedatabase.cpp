@@ -1,6 +1,8 @@
 // Copyright (c) 2022-2024 Manuel Schneider
 
+#include "datachanges.h"
 #include "extension.h"
+#include "globalqueryhandler.h"
 #include "logging.h"
 #include "rankitem.h"
 #include "usagedatabase.h"
@@ -12,6 +14,7 @@
 #include <QSqlError>
 #include <QSqlQuery>
 #include <QTimer>
+#include <algorithm>
 #include <mutex>
 #include <shared_mutex>
 using namespace albert;
@@ -35,8 +38,10 @@ struct std::hash<Key>
 
 shared_mutex UsageHistory::global_data_mutex_;
 UsageScores UsageHistory::usage_scores_;
+map<QString, uint> UsageHistory::query_counts_;
 bool UsageHistory::prioritize_perfect_match_;
 double UsageHistory::memory_decay_;
+atomic<uint64_t> UsageHistory::generation_ = 0;
 recursive_mutex UsageHistory::db_recursive_mutex_;
 
 Activation::Activation(QString q, QString e, QString i, QString a):
@@ -54,7 +59,7 @@ void UsageHistory::initialize()
     updateScores();
 }
 
-void UsageHistory::applyScore(const QString &extension_id, RankItem *rank_item)
+void UsageHistory::applyScore(const QString &extension_id, const Item &item, double &score)
 {
     /*
      *  p  r     | ( 3, 4] |  3 + mru_score      | prioritized recent perfect matches
@@ -64,21 +69,21 @@ void UsageHistory::applyScore(const QString &extension_id, RankItem *rank_item)
      * !p !r !m  | (-1, 0] |  -1 + 1 / text_len  | no match
      */
 
-    const Key key(extension_id, rank_item->item->id());
+    const Key key(extension_id, item.id());
 
-    if (prioritize_perfect_match_ && rank_item->score == 1.0f)
+    if (prioritize_perfect_match_ && score == 1.0f)
     {
         if (const auto &it = usage_scores_.find(key); it != usage_scores_.end())
-            rank_item->score = 3.0f + it->second;
+            score = 3.0f + it->second;
         else
-            rank_item->score = 2.0f + 1.0f / rank_item->item->text().length();
+            score = 2.0f + 1.0f / item.text().length();
     }
     else
     {
         if (const auto &it = usage_scores_.find(key); it != usage_scores_.end())
-            rank_item->score = 1.0f + it->second;
-        else if (rank_item->score == 0.0f)
-            rank_item->score = -1.0f + 1.0f / rank_item->item->text().length();
+            score = 1.0f + it->second;
+        else if (score == 0.0f)
+            score = -1.0f + 1.0f / item.text().length();
         // else score remains unmodified
     }
 }
@@ -87,14 +92,38 @@ void UsageHistory::applyScores(const QString &id, vector<RankItem> &rank_items)
 {
     shared_lock lock(global_data_mutex_);
     for (auto &rank_item : rank_items)
-        applyScore(id, &rank_item);
+        applyScore(id, *rank_item.item, rank_item.score);
 }
 
 void UsageHistory::applyScores(vector<pair<Extension *, RankItem>> *rank_items)
 {
     shared_lock lock(global_data_mutex_);
     for (auto &[extension, rank_item] : *rank_items)
-        applyScore(extension->id(), &rank_item);
+        applyScore(extension->id(), *rank_item.item, rank_item.score);
+}
+
+void UsageHistory::applyScores(const QString &id, const ItemIndex &index,
+                               vector<ItemIndex::Match> &matches)
+{
+    shared_lock lock(global_data_mutex_);
+    for (auto &[slot, score] : matches)
+        applyScore(id, *index.item(slot), score);
+}
+
+void UsageHistory::applyScores(const ItemIndex &index,
+                               const function<const Extension*(uint32_t)> &owner,
+                               vector<ItemIndex::Match> &matches)
+{
+    unordered_map<const Extension*, QString> ids;  // Few owners, many matches
+    shared_lock lock(global_data_mutex_);
+    for (auto &[slot, score] : matches)
+    {
+        const auto *extension = owner(slot);
+        auto it = ids.find(extension);
+        if (it == ids.end())
+            it = ids.emplace(extension, extension->id()).first;
+        applyScore(it->second, *index.item(slot), score);
+    }
 }
 
 double UsageHistory::memoryDecay()
@@ -197,7 +226,51 @@ void UsageHistory::updateScores()
         rank += 1.0;
     }
 
-    usage_scores_ = ::move(usage_scores);
+    // Count the activation queries for predictions
+    map<QString, uint> query_counts;
+    for (const auto &activation : activations)
+        if (!activation.query.isEmpty())
+            ++query_counts[activation.query];
+
+    {
+        unique_lock data_lock(global_data_mutex_);
+        usage_scores_ = ::move(usage_scores);
+        query_counts_ = ::move(query_counts);
+    }
+    ++generation_;
+    DataChanges::notify();
+}
+
+QStringList UsageHistory::predictNext(const QString &prefix, uint count)
+{
+    map<QChar, uint> continuations;
+    {
+        shared_lock lock(global_data_mutex_);
+        for (auto it = query_counts_.lower_bound(prefix);
+             it != query_counts_.end() && it->first.startsWith(prefix); ++it)
+            if (it->first.size() > prefix.size())
+                continuations[it->first[prefix.size()]] += it->second;
+    }
+
+    vector<pair<QChar, uint>> ranked(continuations.begin(), continuations.end());
+    sort(ranked.begin(), ranked.end(), [](auto &l, auto &r){ return l.second > r.second; });
+
+    QStringList predictions;
+    for (size_t i = 0; i < ranked.size() && i < count; ++i)
+        predictions << prefix + ranked[i].first;
+    return predictions;
+}
+
+uint64_t UsageHistory::generation() { return generation_; }
+
+unordered_map<QString, double> UsageHistory::itemScores(const QString &extension_id)
+{
+    unordered_map<QString, double> scores;
+    shared_lock lock(global_data_mutex_);
+    for (const auto &[key, score] : usage_scores_)
+        if (key.first == extension_id)
+            scores.emplace(key.second, score);
+    return scores;
 }
 
 
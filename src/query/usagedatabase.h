@@ -1,8 +1,13 @@
 // Copyright (c) 2022-2024 Manuel Schneider
 
 #pragma once
+#include "itemindex.h"
 #include <QSqlDatabase>
 #include <QString>
+#include <QStringList>
+#include <atomic>
+#include <functional>
+#include <map>
 #include <mutex>
 #include <shared_mutex>
 #include <unordered_map>
@@ -10,6 +15,7 @@
 class QDateTime;
 namespace albert {
 class Extension;
+class Item;
 class RankItem;
 }
 
@@ -32,6 +38,16 @@ public:
     static void applyScores(const QString &id, std::vector<albert::RankItem> &rank_items);
     static void applyScores(std::vector<std::pair<albert::Extension*,albert::RankItem>>*);
 
+    /// Applies the scores to the matches of the items of the index of extension id.
+    static void applyScores(const QString &id, const albert::ItemIndex &index,
+                            std::vector<albert::ItemIndex::Match> &matches);
+
+    /// Applies the scores to the matches of the items of an index, owned by
+    /// several extensions. owner returns the extension of the item in a slot.
+    static void applyScores(const albert::ItemIndex &index,
+                            const std::function<const albert::Extension*(uint32_t)> &owner,
+                            std::vector<albert::ItemIndex::Match> &matches);
+
     static double memoryDecay();
     static void setMemoryDecay(double);
 
@@ -43,14 +59,27 @@ public:
 
     static std::map<QString, uint> activationsSince(const QDateTime &query);
 
+    /// Incremented whenever the usage scores change.
+    static uint64_t generation();
+
+    /// The usage scores of the items of an extension, keyed by item id.
+    static std::unordered_map<QString, double> itemScores(const QString &extension_id);
+
+    /// The most likely queries one char longer than prefix.
+    /// Ranked by the activation counts of the queries they are a prefix of.
+    static QStringList predictNext(const QString &prefix, uint count);
+
 private:
-    inline static void applyScore(const QString &extension_id, albert::RankItem *rank_item);
+    inline static void applyScore(const QString &extension_id, const albert::Item &item,
+                                  double &score);
     static void updateScores();
 
     static std::shared_mutex global_data_mutex_;
     static UsageScores usage_scores_;
+    static std::map<QString, uint> query_counts_;
     static bool prioritize_perfect_match_;
     static double memory_decay_;
+    static std::atomic<uint64_t> generation_;
 
     static std::recursive_mutex db_recursive_mutex_;
     static void db_connect();
@@ -0,0 +1,51 @@
+// Copyright (c) 2024 Manuel Schneider
+
+#include "cachingglobalqueryhandler.h"
+#include "query.h"
+#include <mutex>
+using namespace albert;
+using namespace std;
+
+class CachingGlobalQueryHandler::Private
+{
+public:
+    size_t max_items;
+    once_flag once;
+    unique_ptr<ResultCache> cache;
+};
+
+CachingGlobalQueryHandler::CachingGlobalQueryHandler(size_t max_items):
+    d(make_unique<Private>())
+{ d->max_items = max_items; }
+
+CachingGlobalQueryHandler::~CachingGlobalQueryHandler() = default;
+
+ResultCache &CachingGlobalQueryHandler::resultCache()
+{
+    // Lazy since id() is not available in the constructor
+    call_once(d->once, [this]{ d->cache = make_unique<ResultCache>(id(), d->max_items); });
+    return *d->cache;
+}
+
+QString CachingGlobalQueryHandler::cacheKey(const Query *query) const
+{ return query->string().simplified(); }
+
+vector<RankItem> CachingGlobalQueryHandler::handleGlobalQuery(const Query *query)
+{
+    auto &cache = resultCache();
+    const auto key = cacheKey(query);
+
+    if (auto results = cache.get(key); results)
+        return ::move(*results);
+
+    const auto generation = cache.generation();
+    auto results = handleUncachedGlobalQuery(query);
+
+    // Results of cancelled queries may be incomplete
+    if (query->isValid())
+        cache.put(key, generation, results);
+
+    return results;
+}
+
+void CachingGlobalQueryHandler::invalidateResultCache() { resultCache().invalidate(); }
@@ -0,0 +1,11 @@
+// Copyright (c) 2024 Manuel Schneider
+
+#include "datachanges.h"
+
+DataChanges &DataChanges::instance()
+{
+    static DataChanges instance;
+    return instance;
+}
+
+void DataChanges::notify() { emit instance().changed(); }
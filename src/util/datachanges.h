@@ -0,0 +1,29 @@
+// Copyright (c) 2024 Manuel Schneider
+
+#pragma once
+#include <QObject>
+
+///
+/// Notifies about changes of the data queries run on.
+///
+/// Emitted whenever ItemIndex::generation() or UsageHistory::generation()
+/// changed. Changes happen in arbitrary threads, hence receivers get queued
+/// calls. Several changes may be delivered at once.
+///
+class DataChanges : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    static DataChanges &instance();
+
+    /// Emits changed(). Called by the data sources after incrementing their generation.
+    /// @threadsafe
+    static void notify();
+
+signals:
+
+    void changed();
+
+};
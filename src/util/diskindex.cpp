@@ -0,0 +1,407 @@
+// Copyright (c) 2024 Manuel Schneider
+
+#include "diskindex.h"
+#include "logging.h"
+#include "matchconfig.h"
+#include "matchkernels.h"
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <algorithm>
+#include <cstring>
+using namespace albert;
+using namespace std;
+
+namespace
+{
+
+static const char magic[8] = {'A', 'L', 'B', 'D', 'I', 'D', 'X', '1'};
+static const QChar field_separator(0x1f);  // ASCII unit separator
+
+// Bloom filter over the word prefixes up to this length
+static const uint bloom_prefix_length = 6;
+static const uint bloom_hashes = 3;
+static const uint bloom_bits_per_key = 10;
+
+struct Header
+{
+    char magic[8];
+    uint32_t entry_count;
+    uint32_t word_count;
+    uint64_t bloom_bits;
+    uint64_t words_offset;     // WordRecord[word_count]
+    uint64_t postings_offset;  // uint32_t[postings_length], ascending per word
+    uint64_t postings_length;
+    uint64_t entries_offset;   // EntryRecord[entry_count]
+    uint64_t text_offset;      // char16_t[text_length], fields and words
+    uint64_t text_length;
+    uint64_t bloom_offset;     // uint64_t[(bloom_bits + 63) / 64]
+};
+
+struct WordRecord
+{
+    uint32_t text_offset;
+    uint32_t text_length;
+    uint32_t postings_offset;
+    uint32_t postings_count;
+};
+
+struct EntryRecord
+{
+    uint32_t fields_offset;
+    uint32_t fields_length;
+    uint32_t max_match_len;
+};
+
+static_assert(sizeof(EntryRecord) == 3 * sizeof(uint32_t));
+
+// Stable across processes and Qt versions, unlike qHash
+static uint64_t fnv1a(QStringView s, uint64_t seed)
+{
+    uint64_t h = 14695981039346656037ull ^ seed;
+    for (QChar c : s)
+    {
+        h ^= c.unicode();
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+template<class F>
+static void forBloomBits(QStringView key, uint64_t bits, F &&f)
+{
+    const uint64_t h1 = fnv1a(key, 0);
+    const uint64_t h2 = fnv1a(key, 0x9e3779b97f4a7c15ull) | 1;
+    for (uint i = 0; i < bloom_hashes; ++i)
+        f((h1 + i * h2) % bits);
+}
+
+static QStringList tokenize(const QString &string)
+{
+    static const MatchConfig config;
+    static const auto tokenizer = matchkernels::selectTokenizer(config);
+    return tokenizer(string, config.separator_regex);
+}
+
+}
+
+
+struct DiskIndex::Shard
+{
+    QFile file;
+    const Header *header = nullptr;
+    const WordRecord *words = nullptr;
+    const uint32_t *postings = nullptr;
+    const EntryRecord *entries = nullptr;
+    const char16_t *text = nullptr;
+    const uint64_t *bloom = nullptr;
+
+    bool open(const QString &path)
+    {
+        file.setFileName(path);
+        if (!file.open(QIODevice::ReadOnly))
+            return false;
+
+        const auto size = (uint64_t)file.size();
+        if (size < sizeof(Header))
+            return false;
+
+        const uchar *data = file.map(0, file.size());
+        if (!data)
+            return false;
+
+        header = reinterpret_cast<const Header*>(data);
+        const auto &h = *header;
+
+        auto fits = [size](uint64_t offset, uint64_t count, uint64_t element_size)
+        { return offset <= size && count <= (size - offset) / element_size; };
+
+        if (memcmp(h.magic, magic, sizeof(magic)) != 0
+            || h.bloom_bits == 0
+            || !fits(h.words_offset, h.word_count, sizeof(WordRecord))
+            || !fits(h.postings_offset, h.postings_length, sizeof(uint32_t))
+            || !fits(h.entries_offset, h.entry_count, sizeof(EntryRecord))
+            || !fits(h.text_offset, h.text_length, sizeof(char16_t))
+            || !fits(h.bloom_offset, (h.bloom_bits + 63) / 64, sizeof(uint64_t)))
+            return false;
+
+        words = reinterpret_cast<const WordRecord*>(data + h.words_offset);
+        postings = reinterpret_cast<const uint32_t*>(data + h.postings_offset);
+        entries = reinterpret_cast<const EntryRecord*>(data + h.entries_offset);
+        text = reinterpret_cast<const char16_t*>(data + h.text_offset);
+        bloom = reinterpret_cast<const uint64_t*>(data + h.bloom_offset);
+        return true;
+    }
+
+    QStringView textAt(uint64_t offset, uint64_t length) const
+    {
+        if (offset > header->text_length || length > header->text_length - offset)
+            return {};
+        return QStringView(text + offset, (qsizetype)length);
+    }
+
+    QStringView word(uint32_t i) const
+    { return textAt(words[i].text_offset, words[i].text_length); }
+
+    bool mayContainPrefix(QStringView prefix) const
+    {
+        bool found = true;
+        forBloomBits(prefix.left(bloom_prefix_length), header->bloom_bits,
+                     [&](uint64_t bit){ found &= (bloom[bit / 64] >> (bit % 64)) & 1; });
+        return found;
+    }
+
+    // Ascending unique entries having a word starting with prefix
+    vector<uint32_t> entriesWithPrefix(QStringView prefix) const
+    {
+        vector<uint32_t> result;
+
+        uint32_t lo = 0, hi = header->word_count;
+        while (lo < hi)
+        {
+            uint32_t mid = lo + (hi - lo) / 2;
+            if (word(mid) < prefix)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+
+        for (uint32_t w = lo; w < header->word_count && word(w).startsWith(prefix); ++w)
+        {
+            const auto &r = words[w];
+            if (r.postings_offset > header->postings_length
+                || r.postings_count > header->postings_length - r.postings_offset)
+                continue;
+            result.insert(result.end(), postings + r.postings_offset,
+                          postings + r.postings_offset + r.postings_count);
+        }
+
+        sort(result.begin(), result.end());
+        result.erase(unique(result.begin(), result.end()), result.end());
+        return result;
+    }
+};
+
+
+DiskIndex::DiskIndex(const QString &directory)
+{
+    QDir dir(directory);
+    for (const auto &name : dir.entryList({"shard-*.idx"}, QDir::Files, QDir::Name))
+    {
+        auto shard = make_unique<Shard>();
+        if (shard->open(dir.filePath(name)))
+            shards_.emplace_back(::move(shard));
+        else
+            WARN << "Skipping invalid index shard:" << dir.filePath(name);
+    }
+}
+
+DiskIndex::~DiskIndex() = default;
+
+size_t DiskIndex::size() const
+{
+    size_t size = 0;
+    for (const auto &shard : shards_)
+        size += shard->header->entry_count;
+    return size;
+}
+
+vector<DiskIndex::Match>
+DiskIndex::search(const QString &string, const bool &isValid, uint limit) const
+{
+    vector<Match> matches;
+
+    const auto tokens = tokenize(string);
+    if (tokens.isEmpty())
+        return matches;
+
+    auto by_score = [](const Match &l, const Match &r){ return l.score > r.score; };
+
+    for (uint32_t s = 0; s < (uint32_t)shards_.size(); ++s)
+    {
+        if (!isValid)
+            return {};
+
+        const auto &shard = *shards_[s];
+
+        // Skip the shard unless all words may be contained
+        if (!ranges::all_of(tokens, [&](const auto &t){ return shard.mayContainPrefix(t); }))
+            continue;
+
+        // Intersect the entries of the words
+        vector<uint32_t> candidates;
+        double matched_chars = 0;
+        for (int t = 0; t < tokens.size(); ++t)
+        {
+            auto entries = shard.entriesWithPrefix(tokens[t]);
+            if (t == 0)
+                candidates = ::move(entries);
+            else
+            {
+                vector<uint32_t> intersection;
+                set_intersection(candidates.begin(), candidates.end(),
+                                 entries.begin(), entries.end(),
+                                 back_inserter(intersection));
+                candidates = ::move(intersection);
+            }
+
+            if (candidates.empty())
+                break;
+
+            matched_chars += tokens[t].size();
+        }
+
+        for (auto entry : candidates)
+            if (entry < shard.header->entry_count)
+                matches.emplace_back(s, entry,
+                                     min(matched_chars / max(shard.entries[entry].max_match_len, 1u), 1.));
+
+        // Keep the memory bounded
+        if (limit && matches.size() > limit)
+        {
+            nth_element(matches.begin(), matches.begin() + limit - 1, matches.end(), by_score);
+            matches.resize(limit);
+        }
+    }
+
+    return matches;
+}
+
+QStringList DiskIndex::fields(const Match &match) const
+{
+    if (match.shard >= shards_.size())
+        return {};
+
+    const auto &shard = *shards_[match.shard];
+    if (match.entry >= shard.header->entry_count)
+        return {};
+
+    const auto &e = shard.entries[match.entry];
+    auto text = shard.textAt(e.fields_offset, e.fields_length);
+    if (text.isEmpty())
+        return {};
+
+    return text.toString().split(field_separator);
+}
+
+
+DiskIndex::Builder::Builder(const QString &directory, uint shard_size):
+    directory_(directory), shard_size_(max(shard_size, 1u))
+{
+    if (!QDir().mkpath(directory_))
+    {
+        WARN << "Failed creating index directory:" << directory_;
+        ok_ = false;
+    }
+}
+
+DiskIndex::Builder::~Builder() = default;
+
+void DiskIndex::Builder::add(const QString &string, const QStringList &fields)
+{
+    const auto tokens = tokenize(string);
+    if (tokens.isEmpty())
+        return;
+
+    const auto entry = (uint32_t)(entries_.size() / 3);
+
+    uint32_t max_match_len = 0;
+    for (const auto &token : tokens)
+    {
+        auto &postings = words_[token];
+        if (postings.empty() || postings.back() != entry)
+            postings.emplace_back(entry);
+        max_match_len += token.size();
+    }
+
+    const auto joined = fields.join(field_separator);
+    entries_.emplace_back((uint32_t)fields_.size());
+    entries_.emplace_back((uint32_t)joined.size());
+    entries_.emplace_back(max_match_len);
+    fields_.insert(fields_.end(), joined.utf16(), joined.utf16() + joined.size());
+
+    if (entries_.size() / 3 >= shard_size_)
+        flush();
+}
+
+bool DiskIndex::Builder::finish()
+{
+    flush();
+    return ok_;
+}
+
+bool DiskIndex::Builder::flush()
+{
+    if (entries_.empty())
+        return true;
+
+    Header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, magic, sizeof(magic));
+    h.entry_count = (uint32_t)(entries_.size() / 3);
+    h.word_count = (uint32_t)words_.size();
+
+    size_t bloom_keys = 0;
+    for (const auto &[word, _] : words_)
+        bloom_keys += min<size_t>(word.size(), bloom_prefix_length);
+    h.bloom_bits = max<uint64_t>(64, bloom_keys * bloom_bits_per_key);
+    vector<uint64_t> bloom((h.bloom_bits + 63) / 64, 0);
+
+    // Words are appended to the fields text
+    vector<WordRecord> words;
+    words.reserve(words_.size());
+    vector<uint32_t> postings;
+    auto text = ::move(fields_);
+    for (const auto &[word, word_postings] : words_)
+    {
+        words.emplace_back((uint32_t)text.size(), (uint32_t)word.size(),
+                           (uint32_t)postings.size(), (uint32_t)word_postings.size());
+        text.insert(text.end(), word.utf16(), word.utf16() + word.size());
+        postings.insert(postings.end(), word_postings.begin(), word_postings.end());
+
+        for (qsizetype l = 1; l <= min<qsizetype>(word.size(), bloom_prefix_length); ++l)
+            forBloomBits(QStringView(word).left(l), h.bloom_bits,
+                         [&](uint64_t bit){ bloom[bit / 64] |= 1ull << (bit % 64); });
+    }
+    h.postings_length = postings.size();
+    h.text_length = text.size();
+
+    // Sections are 8 byte aligned
+    auto align = [](uint64_t o){ return (o + 7) & ~uint64_t(7); };
+    h.words_offset = align(sizeof(Header));
+    h.postings_offset = align(h.words_offset + words.size() * sizeof(WordRecord));
+    h.entries_offset = align(h.postings_offset + postings.size() * sizeof(uint32_t));
+    h.text_offset = align(h.entries_offset + entries_.size() * sizeof(uint32_t));
+    h.bloom_offset = align(h.text_offset + text.size() * sizeof(char16_t));
+
+    const auto path = QDir(directory_).filePath(QString("shard-%1.idx").arg(shard_count_, 6, 10, QChar('0')));
+    QSaveFile file(path);
+    bool ok = file.open(QIODevice::WriteOnly);
+
+    auto write = [&](uint64_t offset, const void *data, uint64_t size)
+    {
+        if (ok && file.pos() < (qint64)offset)
+            ok = file.write(QByteArray((qsizetype)(offset - file.pos()), '\0')) != -1;
+        if (ok && size)
+            ok = file.write(static_cast<const char*>(data), (qint64)size) == (qint64)size;
+    };
+
+    write(0, &h, sizeof(h));
+    write(h.words_offset, words.data(), words.size() * sizeof(WordRecord));
+    write(h.postings_offset, postings.data(), postings.size() * sizeof(uint32_t));
+    write(h.entries_offset, entries_.data(), entries_.size() * sizeof(uint32_t));
+    write(h.text_offset, text.data(), text.size() * sizeof(char16_t));
+    write(h.bloom_offset, bloom.data(), bloom.size() * sizeof(uint64_t));
+
+    if (!ok || !file.commit())
+    {
+        WARN << "Failed writing index shard:" << path << file.errorString();
+        ok_ = false;
+    }
+
+    ++shard_count_;
+    words_.clear();
+    entries_.clear();
+    fields_.clear();
+    return ok;
+}
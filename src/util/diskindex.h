@@ -0,0 +1,86 @@
+// Copyright (c) 2024 Manuel Schneider
+
+#pragma once
+#include <QString>
+#include <QStringList>
+#include <map>
+#include <memory>
+#include <vector>
+class QFile;
+
+///
+/// An out-of-core index of strings with stored fields.
+///
+/// The index consists of immutable shard files which are memory mapped. Each
+/// shard has a sorted word dictionary, postings, the stored fields of its
+/// entries and a Bloom filter over the word prefixes to skip shards cheaply.
+/// Resident memory is bounded by the pages touched by a search, which the
+/// kernel may reclaim at any time.
+///
+/// Matching is case and diacritics insensitive, word order independent and
+/// prefix based. Fuzzy matching is not supported.
+///
+class DiskIndex
+{
+public:
+
+    struct Match
+    {
+        uint32_t shard;
+        uint32_t entry;
+        double score;
+    };
+
+    /// Opens the shards in directory.
+    /// Invalid shards are skipped with a warning.
+    explicit DiskIndex(const QString &directory);
+    ~DiskIndex();
+
+    /// The number of entries of all shards.
+    size_t size() const;
+
+    /// The best matches of all words of string.
+    /// @param limit The maximum number of matches. 0 means unlimited.
+    std::vector<Match> search(const QString &string, const bool &isValid, uint limit) const;
+
+    /// The stored fields of a match.
+    QStringList fields(const Match &match) const;
+
+
+    ///
+    /// Writes the shards of a DiskIndex.
+    ///
+    /// Only the entries of the current shard are kept in memory.
+    ///
+    class Builder
+    {
+    public:
+
+        Builder(const QString &directory, uint shard_size = 1 << 16);
+        ~Builder();
+
+        void add(const QString &string, const QStringList &fields);
+
+        /// Writes the pending entries. Returns false if any shard failed to write.
+        bool finish();
+
+    private:
+
+        bool flush();
+
+        QString directory_;
+        uint shard_size_;
+        uint shard_count_ = 0;
+        bool ok_ = true;
+
+        std::map<QString, std::vector<uint32_t>> words_;
+        std::vector<uint32_t> entries_;  // (fields offset, fields length, max match length)
+        std::vector<char16_t> fields_;
+    };
+
+private:
+
+    struct Shard;
+    std::vector<std::unique_ptr<Shard>> shards_;
+
+};
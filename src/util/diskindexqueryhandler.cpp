@@ -0,0 +1,197 @@
+// Copyright (c) 2024 Manuel Schneider
+
+#include "diskindex.h"
+#include "diskindexqueryhandler.h"
+#include "logging.h"
+#include "query.h"
+#include "util.h"
+#include <QDateTime>
+#include <QDir>
+#include <QThreadPool>
+#include <atomic>
+#include <mutex>
+#include <utility>
+using namespace albert;
+using namespace std;
+
+static const QString tmp_prefix = QStringLiteral("tmp-");
+static const qint64 process_start = QDateTime::currentMSecsSinceEpoch();
+
+// Removing large generations takes a while. Not on the query workers.
+static void removeInBackground(const QStringList &paths)
+{
+    if (!paths.isEmpty())
+        QThreadPool::globalInstance()->start([paths]{
+            for (const auto &path : paths)
+                if (!QDir(path).removeRecursively())
+                    WARN << "Failed removing disk index:" << path;
+        });
+}
+
+class DiskIndexQueryHandler::Private
+{
+public:
+    DiskIndexQueryHandler *q;
+    atomic<uint> result_limit = 100;
+
+    mutex mutex_;
+    bool loaded = false;
+    shared_ptr<const DiskIndex> index;
+    QString generation;
+
+    // Not available to writers, which may outlive the handler
+    QDir directory() const
+    { return QDir(QString("%1/diskindex/%2").arg(cacheLocation(), q->id())); }
+
+    // Lazy since id() is not available in the constructor
+    shared_ptr<const DiskIndex> currentIndex(const QDir &dir)
+    {
+        unique_lock lock(mutex_);
+        if (!loaded)
+        {
+            loaded = true;
+
+            QStringList generations;
+            QStringList obsolete;
+            for (const auto &g : dir.entryList(QDir::Dirs | QDir::NoDotAndDotDot, QDir::Name))
+                if (!g.startsWith(tmp_prefix))
+                    generations << g;
+                else if (g.mid(tmp_prefix.size(), 16).toLongLong() < process_start)
+                    // Leftovers of crashed writers. Not those of writers of this process.
+                    obsolete << dir.filePath(g);
+
+            // Use the latest committed generation, remove the others
+            if (!generations.isEmpty())
+            {
+                generation = generations.takeLast();
+                index = make_shared<DiskIndex>(dir.filePath(generation));
+                DEBG << QString("Loaded disk index '%1' with %2 entries.")
+                            .arg(dir.dirName()).arg(index->size());
+            }
+            for (const auto &g : generations)
+                obsolete << dir.filePath(g);
+
+            removeInBackground(obsolete);
+        }
+        return index;
+    }
+};
+
+
+class DiskIndexQueryHandler::Writer::Private
+{
+public:
+    weak_ptr<DiskIndexQueryHandler::Private> handler;
+    QDir directory;
+    QString path;
+    QString name;
+    DiskIndex::Builder builder;
+    bool committed = false;
+};
+
+DiskIndexQueryHandler::Writer::Writer(unique_ptr<Private> p) : d(::move(p)) {}
+
+DiskIndexQueryHandler::Writer::Writer(Writer &&) = default;
+
+DiskIndexQueryHandler::Writer::~Writer()
+{
+    if (d && !d->committed)
+        QDir(d->path).removeRecursively();
+}
+
+void DiskIndexQueryHandler::Writer::add(const QString &string, const QStringList &fields)
+{ d->builder.add(string, fields); }
+
+bool DiskIndexQueryHandler::Writer::commit()
+{
+    if (d->committed)
+        return false;
+
+    if (!d->builder.finish())
+        return false;
+
+    // Keeps the handler state alive while committing
+    auto h = d->handler.lock();
+    if (!h)
+    {
+        WARN << "Disk index handler destroyed before commit:" << d->path;
+        return false;
+    }
+
+    auto dir = d->directory;
+    h->currentIndex(dir);  // Make sure the current generation is known
+
+    if (!dir.rename(d->path, d->name))
+    {
+        WARN << "Failed committing disk index:" << d->path;
+        return false;
+    }
+    d->committed = true;
+
+    auto index = make_shared<DiskIndex>(dir.filePath(d->name));
+    QString old_generation;
+    {
+        unique_lock lock(h->mutex_);
+        h->index = index;
+        old_generation = ::exchange(h->generation, d->name);
+    }
+
+    // Running searches keep their mappings, unlinking is safe
+    if (!old_generation.isEmpty())
+        removeInBackground({dir.filePath(old_generation)});
+
+    DEBG << QString("Committed disk index '%1' with %2 entries.")
+                .arg(dir.dirName()).arg(index->size());
+    return true;
+}
+
+
+DiskIndexQueryHandler::DiskIndexQueryHandler() : d(make_shared<Private>())
+{ d->q = this; }
+
+DiskIndexQueryHandler::~DiskIndexQueryHandler() = default;
+
+DiskIndexQueryHandler::Writer DiskIndexQueryHandler::indexWriter()
+{
+    // Generation names sort chronologically
+    static atomic<uint> counter = 0;
+    const auto name = QString("%1-%2")
+                          .arg(QDateTime::currentMSecsSinceEpoch(), 16, 10, QChar('0'))
+                          .arg(counter++, 6, 10, QChar('0'));
+    const auto dir = d->directory();
+    const auto path = dir.filePath(tmp_prefix + name);
+
+    return Writer(unique_ptr<Writer::Private>(new Writer::Private{
+        .handler = d,
+        .directory = dir,
+        .path = path,
+        .name = name,
+        .builder = DiskIndex::Builder(path)
+    }));
+}
+
+vector<RankItem> DiskIndexQueryHandler::handleGlobalQuery(const Query *query)
+{
+    vector<RankItem> results;
+
+    auto index = d->currentIndex(d->directory());
+    if (!index)
+        return results;
+
+    auto matches = index->search(query->string(), query->isValid(), d->result_limit);
+
+    results.reserve(matches.size());
+    for (const auto &match : matches)
+    {
+        if (!query->isValid())
+            return {};
+        if (auto item = createItem(index->fields(match)); item)
+            results.emplace_back(::move(item), match.score);
+    }
+
+    return results;
+}
+
+uint DiskIndexQueryHandler::resultLimit() const { return d->result_limit; }
+
+void DiskIndexQueryHandler::setResultLimit(uint limit) { d->result_limit = limit; }
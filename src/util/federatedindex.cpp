@@ -0,0 +1,184 @@
+// Copyright (c) 2024 Manuel Schneider
+
+#include "federatedindex.h"
+#include "globalqueryhandler.h"
+#include "item.h"
+#include "itemindex.h"
+#include "logging.h"
+#include <QThreadPool>
+#include <chrono>
+using namespace albert;
+using namespace std::chrono;
+using namespace std;
+
+FederatedIndex &FederatedIndex::instance(bool fuzzy)
+{
+    static FederatedIndex exact(false);
+    static FederatedIndex error_tolerant(true);
+    return fuzzy ? error_tolerant : exact;
+}
+
+FederatedIndex::FederatedIndex(bool fuzzy) : config_{.fuzzy = fuzzy}, q_(2) {}
+
+FederatedIndex::~FederatedIndex() = default;
+
+void FederatedIndex::setItems(Handler *handler, vector<IndexItem> &&items)
+{
+    unique_lock lock(contributions_mutex_);
+    contributions_.insert_or_assign(handler, make_shared<const vector<IndexItem>>(::move(items)));
+    rebuild(lock);
+}
+
+void FederatedIndex::remove(Handler *handler)
+{
+    unique_lock lock(contributions_mutex_);
+    if (!contributions_.erase(handler))
+        return;
+
+    // Results must not be attributed to removed handlers. Dropping the slots
+    // of handler is cheap, the rebuild freeing them is not.
+    {
+        unique_lock snapshot_lock(snapshot_mutex_);
+        if (snapshot_)
+        {
+            auto snapshot = make_shared<Snapshot>(*snapshot_);
+            dropRemoved(*snapshot);
+            snapshot_ = ::move(snapshot);
+        }
+    }
+
+    QThreadPool::globalInstance()->start([this]{
+        unique_lock l(contributions_mutex_);
+        rebuild(l);
+    });
+}
+
+bool FederatedIndex::accepts(const MatchConfig &config, uint q) const
+{
+    return q == q_
+           && config.separator_regex == config_.separator_regex
+           && config.ignore_case == config_.ignore_case
+           && config.ignore_diacritics == config_.ignore_diacritics
+           && config.ignore_word_order == config_.ignore_word_order
+           && config.fuzzy == config_.fuzzy
+           && config.match_any_word == config_.match_any_word;
+}
+
+bool FederatedIndex::contains(const Handler *handler) const
+{
+    unique_lock lock(contributions_mutex_);
+    return contributions_.contains(const_cast<Handler*>(handler));
+}
+
+void FederatedIndex::rebuild(unique_lock<mutex> &lock)
+{
+    ++revision_;
+
+    // The running rebuild picks up the change
+    if (rebuilding_)
+        return;
+
+    rebuilding_ = true;
+    while (published_revision_ < revision_)
+    {
+        // Builds on a copy of the pointers, contributions may change meanwhile
+        const auto building = revision_;
+        const auto contributions = contributions_;
+        lock.unlock();
+
+        auto snapshot = build(contributions);
+
+        // Handlers may have been removed while building
+        lock.lock();
+        dropRemoved(*snapshot);
+        {
+            unique_lock snapshot_lock(snapshot_mutex_);
+            snapshot_ = ::move(snapshot);
+        }
+        published_revision_ = building;
+    }
+    rebuilding_ = false;
+}
+
+void FederatedIndex::dropRemoved(Snapshot &snapshot) const
+{
+    for (auto &owner : snapshot.owners)
+        if (owner && !contributions_.contains(owner))
+            owner = nullptr;
+}
+
+shared_ptr<FederatedIndex::Snapshot> FederatedIndex::build(const Contributions &contributions) const
+{
+    auto t = system_clock::now();
+
+    auto index = make_shared<ItemIndex>(config_, q_);
+
+    size_t size = 0;
+    vector<const vector<IndexItem>*> sources;
+    sources.reserve(contributions.size());
+    for (const auto &[handler, items] : contributions)
+    {
+        size += items->size();
+        sources.emplace_back(items.get());
+    }
+
+    index->setItems(sources);
+
+    auto snapshot = make_shared<Snapshot>();
+    snapshot->index = ::move(index);
+
+    // The first contributor of an item owns it
+    unordered_map<const Item*, Handler*> owners;
+    owners.reserve(size);
+    for (const auto &[handler, items] : contributions)
+        for (const auto &index_item : *items)
+            owners.emplace(index_item.item.get(), handler);
+
+    snapshot->owners.reserve(snapshot->index->size());
+    for (uint32_t slot = 0; slot < snapshot->index->size(); ++slot)
+        snapshot->owners.emplace_back(owners.at(snapshot->index->item(slot).get()));
+
+    DEBG << QString("Federated index (fuzzy: %1) rebuilt: %2 handlers, %3 entries, %4 ms")
+                .arg(config_.fuzzy).arg(contributions.size()).arg(size)
+                .arg(duration_cast<milliseconds>(system_clock::now() - t).count());
+
+    return snapshot;
+}
+
+FederatedIndex::Handler *FederatedIndex::Results::owner(uint32_t slot) const
+{ return snapshot_->owners[slot]; }
+
+const shared_ptr<Item> &FederatedIndex::Results::item(uint32_t slot) const
+{ return snapshot_->index->item(slot); }
+
+const ItemIndex &FederatedIndex::Results::index() const
+{ return *snapshot_->index; }
+
+FederatedIndex::Results FederatedIndex::match(const QString &string, const bool &isValid) const
+{
+    Results results;
+    {
+        unique_lock lock(snapshot_mutex_);
+        results.snapshot_ = snapshot_;
+    }
+
+    if (results.snapshot_)
+    {
+        results.matches = results.snapshot_->index->match(string, isValid);
+        erase_if(results.matches, [&](const auto &m){  // Of removed handlers
+            return results.owner(m.slot) == nullptr; });
+    }
+    return results;
+}
+
+vector<RankItem>
+FederatedIndex::search(const QString &string, const bool &isValid, const Handler *handler) const
+{
+    // Materializes the items of handler only
+    const auto results = match(string, isValid);
+    vector<RankItem> rank_items;
+    for (const auto &[slot, score] : results.matches)
+        if (results.owner(slot) == handler)
+            rank_items.emplace_back(results.item(slot), score);
+    return rank_items;
+}
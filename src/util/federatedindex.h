@@ -0,0 +1,122 @@
+// Copyright (c) 2024 Manuel Schneider
+
+#pragma once
+#include <QString>
+#include "itemindex.h"
+#include <albert/indexitem.h>
+#include <albert/rankitem.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+namespace albert {
+class GlobalQueryHandler;
+class Item;
+}
+
+///
+/// An item index shared by several handlers.
+///
+/// Handlers contribute their items under their handler tag. A single search
+/// tokenizes the query once and does one pass over the shared word dictionary
+/// and nGram table for all contributors. Results are attributed back to their
+/// handlers.
+///
+/// Rebuilds are coalesced. Changes arriving while a rebuild is running are
+/// picked up by the next rebuild of the running thread.
+///
+/// There is one instance per fuzzy mode. Handlers contribute only if the
+/// index matches like their own index would, see accepts().
+///
+class FederatedIndex
+{
+    struct Snapshot;
+
+public:
+
+    using Handler = albert::GlobalQueryHandler;
+
+    ///
+    /// Search results referring to the items of an index snapshot.
+    ///
+    /// Keeps the snapshot alive, such that the items of the matches can be
+    /// materialized on demand.
+    ///
+    class Results
+    {
+    public:
+        std::vector<albert::ItemIndex::Match> matches;
+
+        /// The handler contributing the item in slot.
+        Handler *owner(uint32_t slot) const;
+
+        /// The item in slot.
+        const std::shared_ptr<albert::Item> &item(uint32_t slot) const;
+
+        /// The index the slots refer to.
+        const albert::ItemIndex &index() const;
+
+    private:
+        friend class FederatedIndex;
+        std::shared_ptr<const Snapshot> snapshot_;
+    };
+
+    /// The shared index of the fuzzy mode.
+    static FederatedIndex &instance(bool fuzzy);
+
+    /// Replaces the items contributed by handler and rebuilds the index.
+    /// Returns before the rebuild if another thread is rebuilding.
+    /// @threadsafe
+    void setItems(Handler *handler, std::vector<albert::IndexItem> &&items);
+
+    /// Removes the items contributed by handler and rebuilds the index in
+    /// the background. Results are not attributed to handler once returned.
+    /// @threadsafe
+    void remove(Handler *handler);
+
+    /// Returns true if the index matches using config and nGram size q.
+    /// @threadsafe
+    bool accepts(const albert::MatchConfig &config, uint q) const;
+
+    /// Returns true if handler contributes to this index.
+    /// @threadsafe
+    bool contains(const Handler *handler) const;
+
+    /// Searches all contributions. Results are attributed to their handlers.
+    /// @threadsafe
+    Results match(const QString &string, const bool &isValid) const;
+
+    /// Searches all contributions returning the results of handler only.
+    /// @threadsafe
+    std::vector<albert::RankItem>
+    search(const QString &string, const bool &isValid, const Handler *handler) const;
+
+    ~FederatedIndex();
+
+private:
+
+    using Contributions = std::map<Handler*, std::shared_ptr<const std::vector<albert::IndexItem>>>;
+
+    FederatedIndex(bool fuzzy);
+    void rebuild(std::unique_lock<std::mutex> &lock);
+    std::shared_ptr<Snapshot> build(const Contributions &contributions) const;
+    void dropRemoved(Snapshot &snapshot) const;  // contributions_mutex_ locked
+
+    struct Snapshot
+    {
+        std::shared_ptr<const albert::ItemIndex> index;
+        std::vector<Handler*> owners;  // By item slot, null if removed
+    };
+
+    const albert::MatchConfig config_;
+    const uint q_;
+    mutable std::mutex contributions_mutex_;
+    Contributions contributions_;
+    uint64_t revision_ = 0;  // Of contributions_
+    uint64_t published_revision_ = 0;
+    bool rebuilding_ = false;
+    mutable std::mutex snapshot_mutex_;
+    std::shared_ptr<const Snapshot> snapshot_;
+
+};
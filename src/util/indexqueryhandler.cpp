@@ -1,57 +1,247 @@
 // Copyright (c) 2023-2024 Manuel Schneider
 
+#include "federatedindex.h"
 #include "indexqueryhandler.h"
 #include "itemindex.h"
 #include "query.h"
+#include "usagedatabase.h"
+#include <algorithm>
 #include <memory>
 #include <mutex>
-#include <shared_mutex>
 using namespace albert;
 using namespace std;
 
+// Smaller indices build fast enough to be published at once
+static const size_t progressive_min_items = 10000;
+static const size_t first_snapshot_items = 4096;
+static const size_t snapshot_growth = 4;  // Builds take 4/3 of a single build
+
+// Items matching any word are plentiful. Global queries get the best only.
+static const uint any_word_top_k = 100;
+
 class IndexQueryHandler::Private
 {
 public:
-    unique_ptr<ItemIndex> index;
-    std::shared_mutex index_mutex;
+    // Indices are immutable once published. The mutex guards the pointers only.
+    mutex index_mutex;
+    shared_ptr<const ItemIndex> index;
+    bool complete = false;  // index has all items of the last setIndexItems
+    size_t published_items = 0;  // Index items in index
+    uint64_t build = 0;  // Superseded builds stop publishing
+    MatchConfig config;
+    uint q = 2;
+
+    // Written in the main thread under the mutex. Other threads read them locked.
+    bool initialized = false;
+    bool federated = false;
+    bool fuzzy = false;
+    bool any_word = false;
+
+    // The federated index the items are contributed to, if any. Only if it
+    // matches like the private index would, e.g. not if matching any word.
+    FederatedIndex *federatedIndex()
+    {
+        unique_lock l(index_mutex);
+        if (!federated)
+            return nullptr;
+        auto &federated_index = FederatedIndex::instance(fuzzy);
+        return federated_index.accepts(MatchConfig{.fuzzy = fuzzy, .match_any_word = any_word}, q)
+                   ? &federated_index : nullptr;
+    }
+
+    // Removes the contribution if the flags move it
+    void setFlags(IndexQueryHandler *handler, bool f, bool z, bool a)
+    {
+        auto *previous = federatedIndex();
+        {
+            unique_lock l(index_mutex);
+            federated = f;
+            fuzzy = z;
+            any_word = a;
+        }
+        if (previous && previous != federatedIndex())
+            previous->remove(handler);
+    }
+
+    shared_ptr<const ItemIndex> snapshot()
+    {
+        unique_lock l(index_mutex);
+        return index;
+    }
+
+    bool publish(uint64_t b, shared_ptr<const ItemIndex> &&i, size_t n, bool c)
+    {
+        unique_lock l(index_mutex);
+        if (b != build)
+            return false;
+        index = ::move(i);
+        published_items = n;
+        complete = c;
+        return true;
+    }
+
+    void reset(const MatchConfig &c)
+    {
+        unique_lock l(index_mutex);
+        ++build;
+        config = c;
+        index = make_shared<ItemIndex>(config, q);
+        published_items = 0;
+        complete = false;
+    }
 };
 
 IndexQueryHandler::IndexQueryHandler() : d(new Private()) {}
 
-IndexQueryHandler::~IndexQueryHandler() = default;
+IndexQueryHandler::~IndexQueryHandler()
+{
+    if (auto *federated_index = d->federatedIndex())
+        federated_index->remove(this);
+}
 
 void IndexQueryHandler::setIndexItems(vector<IndexItem> &&index_items)
 {
-    // Pointer check not necessary since never called before setFuzzyMatching
-    unique_lock l(d->index_mutex);
-    d->index->setItems(::move(index_items));
+    if (auto *federated_index = d->federatedIndex())
+    {
+        federated_index->setItems(this, ::move(index_items));
+
+        // The flags may have changed meanwhile. Then the contribution is outdated.
+        if (d->federatedIndex() != federated_index)
+            federated_index->remove(this);
+        return;
+    }
+
+    uint64_t build;
+    MatchConfig config;
+    uint q;
+    bool complete;
+    size_t published_items;
+    {
+        unique_lock l(d->index_mutex);
+        build = ++d->build;
+        config = d->config;
+        q = d->q;
+        complete = d->complete;
+        published_items = d->published_items;
+    }
+
+    // Queries keep using the complete index until the new one is built. If
+    // there is none, e.g. on startup, publish growing partial indices. The
+    // most frequently used items first. Partial indices of a superseded
+    // build are not replaced by smaller ones.
+    if (!complete && index_items.size() > progressive_min_items)
+    {
+        const auto scores = UsageHistory::itemScores(id());
+        const auto score = [&](const IndexItem &i){
+            auto it = scores.find(i.item->id());
+            return it == scores.end() ? 0. : it->second;
+        };
+        auto used_end = stable_partition(index_items.begin(), index_items.end(),
+                                         [&](const auto &i){ return score(i) > 0.; });
+        stable_sort(index_items.begin(), used_end,
+                    [&](const auto &a, const auto &b){ return score(a) > score(b); });
+
+        size_t n = first_snapshot_items;
+        while (n <= published_items)
+            n *= snapshot_growth;
+
+        for (; n < index_items.size(); n *= snapshot_growth)
+        {
+            auto partial = make_shared<ItemIndex>(config, q);
+            partial->setItems({index_items.begin(), index_items.begin() + (long)n});
+            if (!d->publish(build, ::move(partial), n, false))
+                return;
+        }
+    }
+
+    const auto size = index_items.size();
+    auto index = make_shared<ItemIndex>(config, q);
+    index->setItems(::move(index_items));
+    d->publish(build, ::move(index), size, true);
 }
 
 vector<RankItem> IndexQueryHandler::handleGlobalQuery(const Query *query)
 {
-    // Pointer check not necessary since never called before setFuzzyMatching
-    shared_lock l(d->index_mutex);
-    return d->index->search(query->string(), query->isValid());
+    if (auto *federated_index = d->federatedIndex())
+        return federated_index->search(query->string(), query->isValid(), this);
+
+    // Never called before setFuzzyMatching. Holds the snapshot while searching.
+    const auto index = d->snapshot();
+    return index->search(query->string(), query->isValid(),
+                         index->config().match_any_word ? any_word_top_k : 0);
+}
+
+bool IndexQueryHandler::matchesIndexDirectly() const { return false; }
+
+shared_ptr<const ItemIndex> IndexQueryHandler::globalQueryIndex(uint &limit) const
+{
+    if (!matchesIndexDirectly() || d->federatedIndex())
+        return {};
+
+    // Never called before setFuzzyMatching
+    auto index = d->snapshot();
+    limit = index->config().match_any_word ? any_word_top_k : 0;
+    return index;
 }
 
 bool IndexQueryHandler::supportsFuzzyMatching() const { return true; }
 
 void IndexQueryHandler::setFuzzyMatching(bool fuzzy)
 {
-    if (!d->index)
+    if (!d->initialized)
     {
-        auto c = MatchConfig{.fuzzy = fuzzy};
-        d->index = make_unique<ItemIndex>(c);
+        d->initialized = true;
+        d->setFlags(this, d->federated, fuzzy, d->any_word);
+        d->reset(MatchConfig{.fuzzy = fuzzy, .match_any_word = d->any_word});
         updateIndexItems();
     }
-    else if ((bool)d->index->config().fuzzy != fuzzy)
+    else if (d->fuzzy != fuzzy)
     {
-        auto c = d->index->config();
+        d->setFlags(this, d->federated, fuzzy, d->any_word);
+
+        auto c = d->config;
         c.fuzzy = fuzzy;
+        d->reset(c);
+        updateIndexItems();
+    }
+}
+
+bool IndexQueryHandler::isFederated() const { return d->federatedIndex() != nullptr; }
 
-        d->index_mutex.lock();
-        d->index = make_unique<ItemIndex>(c);
-        d->index_mutex.unlock();
+void IndexQueryHandler::setFederated(bool federated)
+{
+    if (d->federated == federated)
+        return;
+
+    if (d->any_word)  // Takes effect once matching all words
+    {
+        d->setFlags(this, federated, d->fuzzy, d->any_word);
+        return;
+    }
+
+    if (federated && d->initialized)
+        d->reset(d->config);  // Free the private index
+
+    d->setFlags(this, federated, d->fuzzy, d->any_word);
+
+    if (d->initialized)  // Else see setFuzzyMatching
+        updateIndexItems();
+}
+
+bool IndexQueryHandler::matchAnyWord() const { return d->any_word; }
+
+void IndexQueryHandler::setMatchAnyWord(bool any_word)
+{
+    if (d->any_word == any_word)
+        return;
+
+    d->setFlags(this, d->federated, d->fuzzy, any_word);
+
+    if (d->initialized)  // Else see setFuzzyMatching
+    {
+        auto c = d->config;
+        c.match_any_word = any_word;
+        d->reset(c);
         updateIndexItems();
     }
 }
@@ -1,13 +1,19 @@
 // Copyright (c) 2021-2024 Manuel Schneider
 
+#include "datachanges.h"
 #include "item.h"
 #include "itemindex.h"
 #include "levenshtein.h"
 #include "logging.h"
+#include "matchkernels.h"
 #include <QRegularExpression>
+#include <QSet>
 #include <algorithm>
+#include <atomic>
+#include <cstdlib>
 #include <map>
 #include <mutex>
+#include <set>
 #include <shared_mutex>
 #include <unordered_map>
 #include <utility>
@@ -19,7 +25,6 @@ namespace
 
 using Index = uint32_t;
 using Position = uint16_t;
-static const uint N = 2;
 
 
 struct StringIndexItem
@@ -89,60 +94,120 @@ struct IndexData
     ///
     /// The nGram index.
     ///
+    /// The occurrences of each nGram are partitioned by ascending word length.
+    /// Within a partition they are ordered by word index.
+    ///
     unordered_map<QString, vector<Location>> ngrams;
 };
 
+
+///
+/// Reusable dense counters for the fuzzy candidate generation.
+///
+/// Indexed by word index. All counters are zero when the scratch is in the pool.
+///
+struct Scratch
+{
+    vector<uint16_t> counts;
+    vector<uint16_t> last_ngram;  // 1-based query nGram position last counted
+    vector<Index> touched;
+};
+
+
+class ScratchPool
+{
+public:
+    unique_ptr<Scratch> acquire(size_t size)
+    {
+        unique_ptr<Scratch> scratch;
+        {
+            unique_lock lock(mutex_);
+            if (!pool_.empty())
+            {
+                scratch = ::move(pool_.back());
+                pool_.pop_back();
+            }
+        }
+        if (!scratch)
+            scratch = make_unique<Scratch>();
+        if (scratch->counts.size() < size)
+        {
+            scratch->counts.resize(size, 0);
+            scratch->last_ngram.resize(size, 0);
+        }
+        return scratch;
+    }
+
+    void release(unique_ptr<Scratch> scratch)
+    {
+        unique_lock lock(mutex_);
+        pool_.emplace_back(::move(scratch));
+    }
+
+    size_t clear()
+    {
+        unique_lock lock(mutex_);
+        size_t bytes = 0;
+        for (const auto &scratch : pool_)
+            bytes += scratch->counts.capacity() * sizeof(uint16_t)
+                     + scratch->last_ngram.capacity() * sizeof(uint16_t)
+                     + scratch->touched.capacity() * sizeof(Index);
+        pool_.clear();
+        return bytes;
+    }
+
+private:
+    mutex mutex_;
+    vector<unique_ptr<Scratch>> pool_;
+};
+
+static ScratchPool scratch_pool;
+
+static atomic<uint64_t> generation_ = 0;
+
 }
 
 class ItemIndex::Private
 {
 public:
     MatchConfig config;
+    uint q;
     mutable shared_mutex mutex;
     IndexData index;
 
+    // Kernels specialized for the config, selected in the constructor
+    matchkernels::Tokenizer tokenizer = nullptr;
+    vector<WordMatch> (Private::*word_matches)(const QString &, const bool &) const = nullptr;
+
     QStringList tokenize(QString string) const;
     vector<QString> ngrams_for_word(const QString &word)const;
+    template<bool fuzzy>
     vector<WordMatch> getWordMatches(const QString &word, const bool &isValid) const;
     vector<StringMatch> getStringMatches(const QString &word, const bool &isValid) const;
+    vector<pair<Index, double>> searchAnyWord(const QStringList &words, const bool &isValid,
+                                              uint limit) const;
+    vector<Match> match(const QString &string, const bool &isValid, uint limit) const;  // Locked
+    template<class ForEachItem>
+    void setItems(ForEachItem for_each_item);
 };
 
 QStringList ItemIndex::Private::tokenize(QString s) const
-{
-    // Remove soft hyphens
-    s.remove(QChar(0x00AD));
-
-    if (config.ignore_diacritics)
-    {
-        // https://en.wikipedia.org/wiki/Combining_Diacritical_Marks
-        static QRegularExpression re(R"([\x{0300}-\x{036f}])");
-        s = s.normalized(QString::NormalizationForm_D).remove(re);
-    }
-
-    if (config.ignore_case)
-        s = s.toLower();
-
-    auto t = s.split(config.separator_regex, Qt::SkipEmptyParts);
-
-    if (config.ignore_word_order)
-        t.sort();
-
-    return t;
-}
+{ return tokenizer(::move(s), config.separator_regex); }
 
 vector<QString> ItemIndex::Private::ngrams_for_word(const QString &word) const
 {
     vector<QString> ngrams;
     ngrams.reserve(word.size());
-    auto padded = QString("%1%2").arg(QString(N - 1, ' '), word);
+    auto padded = QString("%1%2").arg(QString(q - 1, ' '), word);
     for (int i = 0; i < word.size(); ++i){
-        QString ngram{padded.mid(i, N)};
+        QString ngram{padded.mid(i, q)};
         ngram.shrink_to_fit();
         ngrams.emplace_back(ngram);
     }
     return ngrams;
 }
 
+template<bool fuzzy>
 vector<WordMatch> ItemIndex::Private::getWordMatches(const QString &word, const bool &isValid) const
 {
     vector<WordMatch> matches;
@@ -161,65 +226,104 @@ vector<WordMatch> ItemIndex::Private::getWordMatches(const QString &word, const
         matches.emplace_back(*it, word_length);
 
     // Get the (fuzzy) prefix matches
-    if (config.fuzzy)
+    if constexpr (fuzzy)
     {
         // Exclusion range for already collected prefix matches
         Index exclude_begin = eq_begin - index.words.begin();  // Ignore interval. closed begin [
         Index exclude_end = eq_end - index.words.begin();  // Ignore interval. open end )
 
+        const uint allowed_errors = word_length / MatchConfig::error_tolerance_divisor;
+
+        // Length filter: A word having a prefix within k edits has at least |word|-k chars.
+        const uint minimum_length = word_length - allowed_errors;
+
+        // Count filter: Every edit destroys at most q nGrams of the (front padded) word.
+        const int minimum_match_count = (int)word_length - (int)(allowed_errors * q);
+
+        Levenshtein levenshtein;
+
+        // Words sharing no nGram may match if the bound is not positive. Verify all of them.
+        if (minimum_match_count <= 0)
+        {
+            for (Index word_idx = 0; word_idx < (Index)index.words.size(); ++word_idx)
+            {
+                if (!isValid)
+                    return {};
+
+                if (exclude_begin <= word_idx && word_idx < exclude_end)
+                    continue;
+
+                const auto &other = index.words[word_idx].word;
+                if ((uint)other.size() < minimum_length)
+                    continue;
+
+                if (auto edit_distance =
+                        levenshtein.computePrefixEditDistanceWithLimit(word, other, allowed_errors);
+                    edit_distance <= allowed_errors)
+                    matches.emplace_back(index.words[word_idx], word_length-edit_distance);
+            }
+            return matches;
+        }
+
         auto ngrams = ngrams_for_word(word);
+        auto scratch = scratch_pool.acquire(index.words.size());
+        auto &[counts, last_ngram, touched] = *scratch;
 
-        // Get the words referenced by each nGram
-        unordered_map<Index, uint> word_match_counts;
-        for (const QString &n_gram : ngrams)
+        // Count the nGrams shared with each word
+        for (Position i = 0; i < (Position)ngrams.size(); ++i)
         {
             if (!isValid)
                 return {};
 
             // Get the ngram occurrences
-            if (auto it = index.ngrams.find(n_gram); it != index.ngrams.end())
+            auto it = index.ngrams.find(ngrams[i]);
+            if (it == index.ngrams.end())
+                continue;
+
+            // Skip the partitions of words too short to match
+            const auto &occurrences = it->second;
+            auto begin = lower_bound(occurrences.begin(), occurrences.end(), minimum_length,
+                                     [this](const Location &l, uint len)
+                                     { return (uint)index.words[l.index].word.size() < len; });
+
+            for (auto o = begin; o != occurrences.end(); ++o)
             {
-                // Iterate all ngram occurrences
-                for (const auto &ngram_occurrences : it->second)
-                {
-                    // Excluding the existing perfect matches
-                    if (exclude_begin <= ngram_occurrences.index
-                        && ngram_occurrences.index < exclude_end)
-                        continue;
-
-                    // count the ngrams where position < word_length
-                    if (ngram_occurrences.position < static_cast<Position>(word_length))
-                        ++word_match_counts[ngram_occurrences.index];
-                }
-            }
-        }
+                // Excluding the existing perfect matches
+                if (exclude_begin <= o->index && o->index < exclude_end)
+                    continue;
 
-        // First do a cheap preselection by mathematical bound.
-        // Then compute the edit distance to filter matches.
-        // If there are less than |word_length|-δ*n matching qGrams it is no
-        // match. If the common qGrams are less than |word|-δ*q this implies
-        // that there are more errors than δ.
+                // Positional filter: k edits shift an nGram by at most k positions
+                if ((uint)abs((int)o->position - (int)i) > allowed_errors)
+                    continue;
 
-        Levenshtein levenshtein;
-        uint allowed_errors = word_length / config.error_tolerance_divisor;
-        uint minimum_match_count = word_length - allowed_errors * N;
+                // Count every query nGram at most once per word
+                if (last_ngram[o->index] == i + 1)
+                    continue;
+                last_ngram[o->index] = i + 1;
+
+                if (counts[o->index]++ == 0)
+                    touched.emplace_back(o->index);
+            }
+        }
 
-        for (const auto &[word_idx, ngram_count]: word_match_counts)
+        // Verify the remaining candidates by their edit distance
+        for (Index word_idx : touched)
         {
             if (!isValid)
                 return {};
 
-            if (ngram_count < minimum_match_count)
-                continue;
+            if (counts[word_idx] >= minimum_match_count)
+                if (auto edit_distance =
+                        levenshtein.computePrefixEditDistanceWithLimit(
+                            word, index.words[word_idx].word, allowed_errors);
+                    edit_distance <= allowed_errors)
+                    matches.emplace_back(index.words[word_idx], word_length-edit_distance);
 
-            if (auto edit_distance =
-                    levenshtein.computePrefixEditDistanceWithLimit(
-                        word, index.words[word_idx].word, allowed_errors);
-                    edit_distance > allowed_errors)
-                continue;
-            else
-                matches.emplace_back(index.words[word_idx], word_length-edit_distance);
+            counts[word_idx] = 0;
+            last_ngram[word_idx] = 0;
         }
+        touched.clear();
+        scratch_pool.release(::move(scratch));
     }
 
     return matches;
@@ -230,7 +334,7 @@ ItemIndex::Private::getStringMatches(const QString &word, const bool &isValid) c
 {
     vector<StringMatch> string_matches;
 
-    for (const auto &word_match : getWordMatches(word, isValid))
+    for (const auto &word_match : (this->*word_matches)(word, isValid))
         for (const auto &occurrence : word_match.word_index_item.occurrences)
             string_matches.emplace_back(occurrence.index, occurrence.position, word_match.match_length);
 
@@ -240,9 +344,195 @@ ItemIndex::Private::getStringMatches(const QString &word, const bool &isValid) c
     return string_matches;
 }
 
+vector<pair<Index, double>>
+ItemIndex::Private::searchAnyWord(const QStringList &words, const bool &isValid, uint limit) const
+{
+    // Disjunctive search evaluated using WAND (Broder et al. 2003).
+    //
+    // The score of a string is the sum of the match lengths of the words it matches divided by
+    // its max match length. The posting list of a query word is the union of the occurrence
+    // lists of the index words it matches. The unions are merged lazily, such that skipping a
+    // string does not read the postings in front of it. The max match length of a string is at
+    // least the length of each of its words, which bounds the contribution of an occurrence list
+    // without reading it. Strings whose upper bound, i.e. the sum of the bounds of the query
+    // words it may contain, does not exceed the score of the k-th best item are skipped without
+    // scoring.
+
+    // The occurrences of an index word matched by a query word, ordered by string
+    struct Occurrences
+    {
+        const vector<Location> *locations;
+        size_t position;
+        uint match_length;
+
+        bool exhausted() const { return position == locations->size(); }
+        Index current() const { return (*locations)[position].index; }
+    };
+
+    // The postings of a query word. A min-heap of its occurrence lists by current string.
+    struct Cursor
+    {
+        vector<Occurrences> lists;
+        double upper_bound;
+
+        static bool later(const Occurrences &l, const Occurrences &r)
+        { return l.current() > r.current(); }
+
+        bool exhausted() const { return lists.empty(); }
+        Index current() const { return lists.front().current(); }
+
+        // Moves the lists at strings before string to string
+        void seek(Index string)
+        {
+            while (!lists.empty() && lists.front().current() < string)
+            {
+                pop_heap(lists.begin(), lists.end(), later);
+                auto &o = lists.back();
+                o.position = lower_bound(o.locations->begin() + o.position, o.locations->end(),
+                                         string, [](const Location &l, Index s){ return l.index < s; })
+                             - o.locations->begin();
+                if (o.exhausted())
+                    lists.pop_back();
+                else
+                    push_heap(lists.begin(), lists.end(), later);
+            }
+        }
+
+        // Moves the lists past the current string. Returns the best match length at it.
+        uint next()
+        {
+            const Index string = current();
+            uint match_length = 0;
+            while (!lists.empty() && lists.front().current() == string)
+            {
+                pop_heap(lists.begin(), lists.end(), later);
+                auto &o = lists.back();
+                match_length = max(match_length, o.match_length);
+                while (!o.exhausted() && o.current() == string)  // A word may occur repeatedly
+                    ++o.position;
+                if (o.exhausted())
+                    lists.pop_back();
+                else
+                    push_heap(lists.begin(), lists.end(), later);
+            }
+            return match_length;
+        }
+    };
+
+    // Build a cursor per distinct word without reading the postings
+    vector<Cursor> cursors;
+    for (const auto &word : QSet<QString>(words.begin(), words.end()))
+    {
+        if (!isValid)
+            return {};
+
+        Cursor cursor{{}, 0.};
+        for (const auto &[word_index_item, match_length] : (this->*word_matches)(word, isValid))
+        {
+            if (word_index_item.occurrences.empty())
+                continue;
+            cursor.lists.push_back({&word_index_item.occurrences, 0, match_length});
+            cursor.upper_bound = max(cursor.upper_bound,
+                                     (double)match_length / word_index_item.word.size());
+        }
+
+        if (!cursor.lists.empty())
+        {
+            make_heap(cursor.lists.begin(), cursor.lists.end(), Cursor::later);
+            cursors.emplace_back(::move(cursor));
+        }
+    }
+
+    // The best scores of distinct items. Bounded to limit if limited.
+    unordered_map<Index, double> item_scores;
+    set<pair<double, Index>> top_k;
+
+    auto threshold = [&]{ return limit && top_k.size() == limit ? top_k.begin()->first : -1.; };
+
+    auto offer = [&](Index item, double score)
+    {
+        if (auto it = item_scores.find(item); it != item_scores.end())
+        {
+            if (score <= it->second)
+                return;
+            if (limit)
+            {
+                top_k.erase({it->second, item});
+                top_k.emplace(score, item);
+            }
+            it->second = score;
+        }
+        else if (!limit)
+            item_scores.emplace(item, score);
+        else if (top_k.size() < limit || top_k.begin()->first < score)
+        {
+            if (top_k.size() == limit)
+            {
+                item_scores.erase(top_k.begin()->second);
+                top_k.erase(top_k.begin());
+            }
+            item_scores.emplace(item, score);
+            top_k.emplace(score, item);
+        }
+    };
+
+    while (isValid)
+    {
+        erase_if(cursors, [](const Cursor &c){ return c.exhausted(); });
+        if (cursors.empty())
+            break;
+
+        sort(cursors.begin(), cursors.end(), [](const Cursor &l, const Cursor &r)
+             { return l.current() < r.current(); });
+
+        // Find the pivot, the first cursor at which the accumulated bounds exceed the threshold
+        const double t = threshold();
+        double bound = 0.;
+        size_t pivot = 0;
+        for (; pivot < cursors.size(); ++pivot)
+            if (bound += cursors[pivot].upper_bound; bound > t)
+                break;
+
+        // No remaining string can enter the top-k
+        if (pivot == cursors.size())
+            break;
+
+        const Index pivot_string = cursors[pivot].current();
+
+        if (cursors[0].current() == pivot_string)
+        {
+            // All cursors up to the pivot point to the pivot string. Score it.
+            uint match_length = 0;
+            for (auto &cursor : cursors)
+            {
+                if (cursor.current() != pivot_string)
+                    break;
+                match_length += cursor.next();
+            }
+            const double score = (double)match_length / index.strings[pivot_string].max_match_len;
 
-ItemIndex::ItemIndex(MatchConfig config)
-    : d(new Private{.config = ::move(config), .mutex = {}, .index = {}}) {}
+            // Several query words may match the same word of the string
+            offer(index.strings[pivot_string].item_index, min(score, 1.));
+        }
+        else
+            // Strings before the pivot can not exceed the threshold. Skip them.
+            for (size_t c = 0; c < pivot; ++c)
+                cursors[c].seek(pivot_string);
+    }
+
+    if (!isValid)
+        return {};
+
+    return {item_scores.begin(), item_scores.end()};
+}
+
+ItemIndex::ItemIndex(MatchConfig config, uint q)
+    : d(new Private{.config = ::move(config), .q = max(q, 1u), .mutex = {}, .index = {}})
+{
+    d->tokenizer = matchkernels::selectTokenizer(d->config);
+    d->word_matches = d->config.fuzzy ? &Private::getWordMatches<true>
+                                      : &Private::getWordMatches<false>;
+}
 
 ItemIndex &ItemIndex::operator=(ItemIndex &&) = default;
 
@@ -250,32 +540,35 @@ ItemIndex::ItemIndex(ItemIndex &&) = default;
 
 ItemIndex::~ItemIndex() = default;
 
-const MatchConfig &ItemIndex::config() { return d->config; }
+const MatchConfig &ItemIndex::config() const { return d->config; }
 
-void ItemIndex::setItems(vector<albert::IndexItem> &&index_items)
+uint ItemIndex::ngramSize() const { return d->q; }
+
+template<class ForEachItem>
+void ItemIndex::Private::setItems(ForEachItem for_each_item)
 {
     IndexData new_index;
 
     unordered_map<albert::Item*,Index> item_indices_;  // implicit unique
     map<QString,WordIndexItem> word_index_;  // implicit lexicographical order
 
-    for (auto &[item, string] : index_items)
+    for_each_item([&](auto &&item, const QString &string)
     {
-        QStringList &&words = d->tokenize(string);
+        QStringList &&words = tokenize(string);
         if (words.empty())
         {
             WARN << QString("Skipping index entry '%1'. Tokenization of '%2' yields empty set.")
                         .arg(item->id(), string);
-            continue;
+            return;
         }
 
         // Try to add the item to the temporary item index map (ensures uniqueness)
         // Assume it is going to be added to the end
         const auto &[it, emplaced] = item_indices_.emplace(item.get(), (Index)new_index.items.size());
 
-        // If item does not exist, move it into the index.
+        // If item does not exist, move (or copy) it into the index.
         if (emplaced)
-            new_index.items.emplace_back(::move(item));
+            new_index.items.emplace_back(std::forward<decltype(item)>(item));
 
         // Add string to item mapping.
         auto &string_index_item = new_index.strings.emplace_back(it->second, 0);
@@ -289,7 +582,7 @@ void ItemIndex::setItems(vector<albert::IndexItem> &&index_items)
             // Store the maximal match length for scoring
             string_index_item.max_match_len += words[p].size();
         }
-    }
+    });
 
     new_index.items.shrink_to_fit();
     new_index.strings.shrink_to_fit();
@@ -304,52 +597,111 @@ void ItemIndex::setItems(vector<albert::IndexItem> &&index_items)
     }
     new_index.words.shrink_to_fit();
 
-    if (d->config.fuzzy)
+    if (config.fuzzy)
     {
         // Build n_gram_index
         for (Index word_index = 0; word_index < (Index)new_index.words.size(); ++word_index)
         {
-            auto ngrams = d->ngrams_for_word(new_index.words[word_index].word);
+            auto ngrams = ngrams_for_word(new_index.words[word_index].word);
             for (Position pos = 0 ; pos < (Position)ngrams.size(); ++pos)
                 new_index.ngrams[ngrams[pos]].emplace_back(word_index, pos);
         }
     }
     for (auto &[_, word_refs] : new_index.ngrams)
+    {
+        // Partition by word length for the length filter
+        stable_sort(word_refs.begin(), word_refs.end(),
+                    [&words = new_index.words](const Location &l, const Location &r)
+                    { return words[l.index].word.size() < words[r.index].word.size(); });
         word_refs.shrink_to_fit();
+    }
+
+    {
+        unique_lock lock(mutex);
+        index = ::move(new_index);
+    }
+    ++generation_;
+    DataChanges::notify();
+}
 
-    unique_lock lock(d->mutex);
-    d->index = new_index;
+void ItemIndex::setItems(vector<albert::IndexItem> &&index_items)
+{
+    d->setItems([&](auto add){
+        for (auto &[item, string] : index_items)
+            add(::move(item), string);
+    });
 }
 
-vector<albert::RankItem> ItemIndex::search(const QString &string, const bool &isValid) const
+void ItemIndex::setItems(const vector<const vector<albert::IndexItem>*> &sources)
+{
+    d->setItems([&](auto add){
+        for (const auto *index_items : sources)
+            for (const auto &[item, string] : *index_items)
+                add(item, string);
+    });
+}
+
+uint64_t ItemIndex::generation() { return generation_; }
+
+size_t ItemIndex::releaseScratchMemory() { return scratch_pool.clear(); }
+
+vector<albert::RankItem> ItemIndex::search(const QString &string, const bool &isValid, uint limit) const
 {
     vector<RankItem> result;
-    QStringList &&words = d->tokenize(string);
     shared_lock lock(d->mutex);
+    auto matches = d->match(string, isValid, limit);
+    result.reserve(matches.size());
+    for (const auto &[slot, score] : matches)
+        result.emplace_back(d->index.items[slot], score);
+    return result;
+}
+
+vector<ItemIndex::Match> ItemIndex::match(const QString &string, const bool &isValid, uint limit) const
+{
+    shared_lock lock(d->mutex);
+    return d->match(string, isValid, limit);
+}
+
+const shared_ptr<Item> &ItemIndex::item(uint32_t slot) const { return d->index.items[slot]; }
+
+uint32_t ItemIndex::size() const { return (uint32_t)d->index.items.size(); }
+
+vector<ItemIndex::Match> ItemIndex::Private::match(const QString &string, const bool &isValid,
+                                                   uint limit) const
+{
+    vector<Match> result;
+    QStringList &&words = tokenize(string);
 
     if (words.empty())
     {
         if (string.isEmpty())
         {
             // Return all items
-            result.reserve(d->index.items.size());
-            for (const auto &item : d->index.items)
-                result.emplace_back(item, 0.0f);
+            const auto count = limit ? min<size_t>(limit, index.items.size())
+                                     : index.items.size();
+            result.reserve(count);
+            for (size_t i = 0; i < count; ++i)
+                result.push_back({(uint32_t)i, 0.0});
             return result;
         }
     }
+    else if (config.match_any_word)
+    {
+        for (const auto &[item_idx, score] : searchAnyWord(words, isValid, limit))
+            result.push_back({item_idx, score});
+    }
     else
     {
         unordered_map<Index, double> result_map;
-        vector<StringMatch> string_matches = d->getStringMatches(words[0], isValid);
+        vector<StringMatch> string_matches = getStringMatches(words[0], isValid);
 
-        // In case of multiple words intersect. Todo: user chooses strategy
+        // In case of multiple words intersect
         for (int w = 1; w < words.size(); ++w)
         {
             if (!isValid || string_matches.empty())
                 return {};
 
-            vector<StringMatch> other_string_matches = d->getStringMatches(words[w], isValid);
+            vector<StringMatch> other_string_matches = getStringMatches(words[w], isValid);
 
             if (other_string_matches.empty())
                 return {};
@@ -387,20 +739,30 @@ vector<albert::RankItem> ItemIndex::search(const QString &string, const bool &is
         // Build the list of matched items with their highest scoring match
         for (const auto &match : string_matches)
         {
-            double score = (double)match.match_len / d->index.strings[match.index].max_match_len;
+            double score = (double)match.match_len / index.strings[match.index].max_match_len;
 
             const auto &[it, success] =
-                    result_map.emplace(d->index.strings[match.index].item_index, score);
+                    result_map.emplace(index.strings[match.index].item_index, score);
 
             // Update score if exists and is less
             if (!success && it->second < score)
                 it->second = score;
         }
 
+        vector<pair<Index, double>> scored(result_map.begin(), result_map.end());
+
+        // Keep only the best results if limited
+        if (limit && scored.size() > limit)
+        {
+            nth_element(scored.begin(), scored.begin() + limit - 1, scored.end(),
+                        [](const auto &l, const auto &r){ return l.second > r.second; });
+            scored.resize(limit);
+        }
+
         // Convert results to return type
-        result.reserve(result_map.size());
-        for (const auto &[item_idx, score] : result_map)
-            result.emplace_back(d->index.items[item_idx], score);
+        result.reserve(scored.size());
+        for (const auto &[item_idx, score] : scored)
+            result.push_back({item_idx, score});
 
     }
     return result;
@@ -20,23 +20,66 @@ class ALBERT_EXPORT ItemIndex final
 {
 public:
 
-    ItemIndex(MatchConfig config = {});
+    /// @param config The match config.
+    /// @param q The nGram size used for fuzzy candidate generation.
+    ItemIndex(MatchConfig config = {}, uint q = 2);
     ItemIndex(ItemIndex &&);
     ItemIndex& operator=(ItemIndex &&);
     ~ItemIndex();
 
     /// The index config
-    const MatchConfig &config();
+    const MatchConfig &config() const;
+
+    /// The nGram size
+    uint ngramSize() const;
+
+    /// Incremented whenever the items of any index change.
+    static uint64_t generation();
+
+    /// Frees the search scratch buffers of all indices. They are reallocated on demand.
+    /// @return The number of bytes freed.
+    static size_t releaseScratchMemory();
 
     /// Set the items to be indexed.
     /// @param items The items to be indexed.
     void setItems(std::vector<IndexItem> &&items);
 
+    /// Set the items of several sources to be indexed, in order.
+    /// Saves merging the sources into a single copy first.
+    /// @param sources The items of the sources.
+    void setItems(const std::vector<const std::vector<IndexItem>*> &sources);
+
     /// Search the index for a string.
     /// @param string The string to search for.
     /// @param isValid A flag used to cancel the search.
+    /// @param limit The maximum number of results. 0 means unlimited.
     /// @return A list of scored items.
-    std::vector<RankItem> search(const QString &string, const bool &isValid) const;
+    std::vector<RankItem> search(const QString &string, const bool &isValid, uint limit = 0) const;
+
+    ///
+    /// A scored item slot.
+    ///
+    /// Refers to an item of the index without owning it. Ranking matches
+    /// instead of RankItems saves a shared_ptr copy per result.
+    ///
+    struct Match
+    {
+        uint32_t slot;
+        double score;
+    };
+
+    /// Search the index for a string.
+    /// @param string The string to search for.
+    /// @param isValid A flag used to cancel the search.
+    /// @param limit The maximum number of results. 0 means unlimited.
+    /// @return A list of scored item slots.
+    std::vector<Match> match(const QString &string, const bool &isValid, uint limit = 0) const;
+
+    /// The item in slot. Slots are valid until the items are set again.
+    const std::shared_ptr<Item> &item(uint32_t slot) const;
+
+    /// The number of item slots.
+    uint32_t size() const;
 
 private:
 
@@ -3,6 +3,7 @@
 #include "item.h"
 #include "levenshtein.h"
 #include "matchconfig.h"
+#include "matchkernels.h"
 #include "matcher.h"
 #include <QRegularExpression>
 #include <QStringList>
@@ -18,31 +19,24 @@ public:
     mutable Levenshtein levenshtein;
     QStringList tokens;
 
-    QStringList tokenize(QString s) const
-    {
-        // Remove soft hyphens
-        s.remove(QChar(0x00AD));
-
-        if (config.ignore_diacritics)
-        {
-            // https://en.wikipedia.org/wiki/Combining_Diacritical_Marks
-            static QRegularExpression re(R"([\x{0300}-\x{036f}])");
-            s = s.normalized(QString::NormalizationForm_D).remove(re);
-        }
-
-        if (config.ignore_case)
-            s = s.toLower();
+    // Kernels specialized for the config, see selectKernels
+    matchkernels::Tokenizer tokenize = nullptr;
+    Match (MatcherPrivate::*match_tokens)(const QStringList &) const = nullptr;
 
-        auto t = s.split(config.separator_regex, Qt::SkipEmptyParts);
+    void selectKernels()
+    {
+        tokenize = matchkernels::selectTokenizer(config);
 
-        if (config.ignore_word_order)
-            t.sort();
+        if (config.match_any_word)
+            match_tokens = config.fuzzy ? &MatcherPrivate::matchAnyWord<true>
+                                        : &MatcherPrivate::matchAnyWord<false>;
+        else
+            match_tokens = config.fuzzy ? &MatcherPrivate::matchAllWords<true>
+                                        : &MatcherPrivate::matchAllWords<false>;
 
-        return t;
+        tokens = tokenize(string, config.separator_regex);
     }
 
-    void updateTokens() { tokens = tokenize(string); }
-
     Match match(const QString &s) const
     {
         // Empty query is a 0 score (epsilon) match
@@ -53,8 +47,12 @@ public:
         if (tokens.isEmpty())
             return {-1.};
 
-        QStringList other_tokens = tokenize(s);
+        return (this->*match_tokens)(tokenize(s, config.separator_regex));
+    }
 
+    template<bool fuzzy>
+    Match matchAllWords(const QStringList &other_tokens) const
+    {
         double matched_chars = 0;
         double total_chars = 0;
 
@@ -63,26 +61,12 @@ public:
 
         while (it != tokens.end() && oit != other_tokens.end())
         {
-
-            // if the query word is longer it cant be a prefix
-            if ((it->size() <= oit->size()))
+            // check if the query word is a prefix of the matched word
+            if (auto len = prefixMatchLength<fuzzy>(*it, *oit); len)
             {
-                // check if the query word is a prefix of the matched word
-                if(config.fuzzy)
-                {
-                    uint allowed_errors = it->size() / config.error_tolerance_divisor;
-                    auto edit_distance = levenshtein.computePrefixEditDistanceWithLimit(
-                                *it, *oit, allowed_errors);
-                    if (edit_distance <= allowed_errors)
-                        // Accumulate matched chars and move to the next matcher word
-                        matched_chars += it++->size() - edit_distance;
-                }
-                else  // non fuzzy
-                {
-                    if (oit->startsWith(*it))
-                        // Accumulate matched chars and move to the next matcher word
-                        matched_chars += it++->size();
-                }
+                // Accumulate matched chars and move to the next matcher word
+                matched_chars += len;
+                ++it;
             }
 
             total_chars += oit->size();
@@ -99,6 +83,35 @@ public:
 
         return {-1.};
     }
+
+    template<bool fuzzy>
+    Match matchAnyWord(const QStringList &other_tokens) const
+    {
+        double matched_chars = 0;
+        double total_chars = 0;
+
+        for (const auto &other_token : other_tokens)
+            total_chars += other_token.size();
+
+        // Every matcher word contributes its best match
+        for (const auto &token : tokens)
+        {
+            uint best = 0;
+            for (const auto &other_token : other_tokens)
+                best = max(best, prefixMatchLength<fuzzy>(token, other_token));
+            matched_chars += best;
+        }
+
+        // Several matcher words may match the same word
+        if (matched_chars > 0)
+            return {min(matched_chars/total_chars, 1.)};
+
+        return {-1.};
+    }
+
+    template<bool fuzzy>
+    inline uint prefixMatchLength(const QString &word, const QString &other) const
+    { return matchkernels::matchPrefix<fuzzy>(word, other, levenshtein); }
 };
 
 Matcher::Matcher(const QString &query, MatchConfig config):
@@ -108,7 +121,7 @@ Matcher::Matcher(const QString &query, MatchConfig config):
       .levenshtein = {},
       .tokens = {}
     })
-{ d->updateTokens(); }
+{ d->selectKernels(); }
 
 Matcher::Matcher(Matcher &&o) = default;
 
@@ -0,0 +1,86 @@
+// Copyright (c) 2024 Manuel Schneider
+
+#pragma once
+#include "levenshtein.h"
+#include "matchconfig.h"
+#include <QRegularExpression>
+#include <QStringList>
+
+///
+/// The stages of the match pipeline specialized on the MatchConfig flags.
+///
+/// The flags are template parameters such that disabled features compile to
+/// nothing. Select the instantiations once when the config is known, not per
+/// string.
+///
+namespace matchkernels
+{
+
+template<bool ignore_case, bool ignore_diacritics, bool ignore_word_order>
+QStringList tokenize(QString s, const QRegularExpression &separator_regex)
+{
+    // Remove soft hyphens
+    s.remove(QChar(0x00AD));
+
+    if constexpr (ignore_diacritics)
+    {
+        // https://en.wikipedia.org/wiki/Combining_Diacritical_Marks
+        static const QRegularExpression re(R"([\x{0300}-\x{036f}])");
+        s = s.normalized(QString::NormalizationForm_D).remove(re);
+    }
+
+    if constexpr (ignore_case)
+        s = s.toLower();
+
+    auto t = s.split(separator_regex, Qt::SkipEmptyParts);
+
+    if constexpr (ignore_word_order)
+        t.sort();
+
+    return t;
+}
+
+using Tokenizer = QStringList (*)(QString, const QRegularExpression &);
+
+/// The tokenizer instantiation for the config.
+inline Tokenizer selectTokenizer(const albert::MatchConfig &config)
+{
+    static constexpr Tokenizer tokenizers[8] = {
+        tokenize<false, false, false>,
+        tokenize<true,  false, false>,
+        tokenize<false, true,  false>,
+        tokenize<true,  true,  false>,
+        tokenize<false, false, true>,
+        tokenize<true,  false, true>,
+        tokenize<false, true,  true>,
+        tokenize<true,  true,  true>
+    };
+    return tokenizers[(config.ignore_case ? 1 : 0)
+                      | (config.ignore_diacritics ? 2 : 0)
+                      | (config.ignore_word_order ? 4 : 0)];
+}
+
+/// The number of chars of word matched by a prefix of other. 0 if no match.
+template<bool fuzzy>
+inline uint matchPrefix(const QString &word, const QString &other, Levenshtein &levenshtein)
+{
+    // if the query word is longer it cant be a prefix
+    if (word.size() > other.size())
+        return 0;
+
+    if constexpr (fuzzy)
+    {
+        constexpr uint divisor = albert::MatchConfig::error_tolerance_divisor;
+        const uint allowed_errors = word.size() / divisor;
+        const uint edit_distance =
+            levenshtein.computePrefixEditDistanceWithLimit(word, other, allowed_errors);
+        return edit_distance <= allowed_errors ? word.size() - edit_distance : 0;
+    }
+    else
+    {
+        Q_UNUSED(levenshtein)
+        return other.startsWith(word) ? word.size() : 0;
+    }
+}
+
+}
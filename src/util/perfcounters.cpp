@@ -0,0 +1,165 @@
+// Copyright (c) 2024 Manuel Schneider
+
+#include "logging.h"
+#include "perfcounters.h"
+#include <atomic>
+#include <utility>
+#if defined(Q_OS_LINUX)
+#include <cerrno>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+using namespace std;
+
+static QString humanReadable(uint64_t v)
+{
+    if (v >= 1'000'000'000)
+        return QString("%1G").arg((double)v / 1e9, 0, 'f', 2);
+    if (v >= 1'000'000)
+        return QString("%1M").arg((double)v / 1e6, 0, 'f', 2);
+    if (v >= 1'000)
+        return QString("%1k").arg((double)v / 1e3, 0, 'f', 2);
+    return QString::number(v);
+}
+
+QString PerfCounters::Sample::toString() const
+{
+    if (!valid)
+        return {};
+
+    return QString("cycles %1 instr %2 ipc %3 cache-miss %4 branch-miss %5")
+        .arg(humanReadable(cycles), humanReadable(instructions))
+        .arg(cycles ? (double)instructions / (double)cycles : 0., 0, 'f', 2)
+        .arg(humanReadable(cache_misses), humanReadable(branch_misses));
+}
+
+PerfCounters::Sample &PerfCounters::Sample::operator+=(const Sample &other)
+{
+    if (other.valid)
+    {
+        valid = true;
+        cycles += other.cycles;
+        instructions += other.instructions;
+        cache_misses += other.cache_misses;
+        branch_misses += other.branch_misses;
+    }
+    return *this;
+}
+
+PerfCounters::Sample PerfCounters::Sample::operator/(uint64_t divisor) const
+{
+    if (!valid || divisor == 0)
+        return {};
+    return {true, cycles / divisor, instructions / divisor,
+            cache_misses / divisor, branch_misses / divisor};
+}
+
+PerfCounters &PerfCounters::threadInstance()
+{
+    thread_local PerfCounters instance;
+    return instance;
+}
+
+#if defined(Q_OS_LINUX)
+
+static int openCounter(uint64_t config, int group_fd)
+{
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = group_fd == -1 ? 1 : 0;  // Group is controlled by the leader
+    attr.exclude_kernel = 1;  // Allowed with perf_event_paranoid <= 2
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+
+    // pid 0, cpu -1: The calling thread on any cpu
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+PerfCounters::PerfCounters()
+{
+    static const uint64_t configs[4] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES
+    };
+
+    for (int i = 0; i < 4; ++i)
+    {
+        if (fds_[i] = openCounter(configs[i], leader_); fds_[i] == -1)
+        {
+            static atomic_flag logged = ATOMIC_FLAG_INIT;
+            if (!logged.test_and_set())
+                DEBG << "Hardware performance counters unavailable:" << strerror(errno);
+
+            for (auto &fd : fds_)
+                if (fd != -1)
+                    close(exchange(fd, -1));
+            leader_ = -1;
+            return;
+        }
+
+        if (i == 0)
+            leader_ = fds_[0];
+    }
+}
+
+PerfCounters::~PerfCounters()
+{
+    for (auto fd : fds_)
+        if (fd != -1)
+            close(fd);
+}
+
+bool PerfCounters::isAvailable() const { return leader_ != -1; }
+
+void PerfCounters::start()
+{
+    if (!isAvailable())
+        return;
+
+    ioctl(leader_, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(leader_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+PerfCounters::Sample PerfCounters::stop()
+{
+    Sample s;
+
+    if (!isAvailable())
+        return s;
+
+    ioctl(leader_, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+    struct { uint64_t nr; uint64_t values[4]; } data;
+    if (read(leader_, &data, sizeof(data)) == (ssize_t)sizeof(data) && data.nr == 4)
+    {
+        s.valid = true;
+        s.cycles = data.values[0];
+        s.instructions = data.values[1];
+        s.cache_misses = data.values[2];
+        s.branch_misses = data.values[3];
+    }
+
+    return s;
+}
+
+#else
+
+PerfCounters::PerfCounters() {}
+
+PerfCounters::~PerfCounters() {}
+
+bool PerfCounters::isAvailable() const { return false; }
+
+void PerfCounters::start() {}
+
+PerfCounters::Sample PerfCounters::stop() { return {}; }
+
+#endif
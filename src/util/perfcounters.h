@@ -0,0 +1,58 @@
+// Copyright (c) 2024 Manuel Schneider
+
+#pragma once
+#include <QString>
+#include <cstdint>
+
+///
+/// Hardware performance counters of the calling thread.
+///
+/// Uses perf_event_open on Linux. On other platforms or if the kernel denies
+/// access (e.g. perf_event_paranoid, no PMU in virtual machines) the counters
+/// are unavailable and stop() returns an invalid sample.
+///
+class PerfCounters
+{
+public:
+
+    struct Sample
+    {
+        bool valid = false;
+        uint64_t cycles = 0;
+        uint64_t instructions = 0;
+        uint64_t cache_misses = 0;
+        uint64_t branch_misses = 0;
+
+        /// Compact human readable representation for logs.
+        QString toString() const;
+
+        /// Accumulates the counts of several intervals.
+        Sample &operator+=(const Sample &other);
+
+        /// The counts per unit, e.g. per iteration of a benchmark.
+        Sample operator/(uint64_t divisor) const;
+    };
+
+    /// The counters of the calling thread. Opened lazily on first access.
+    static PerfCounters &threadInstance();
+
+    bool isAvailable() const;
+
+    /// Resets and starts counting.
+    void start();
+
+    /// Stops counting and returns the counts since start().
+    Sample stop();
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters &operator=(const PerfCounters&) = delete;
+    ~PerfCounters();
+
+private:
+
+    PerfCounters();
+
+    int leader_ = -1;
+    int fds_[4] = {-1, -1, -1, -1};
+
+};
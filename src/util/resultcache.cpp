@@ -0,0 +1,167 @@
+// Copyright (c) 2024 Manuel Schneider
+
+#include "resultcache.h"
+#include <QHash>
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <set>
+using namespace albert;
+using namespace std;
+
+namespace
+{
+
+// All caches, for the report
+static mutex registry_mutex;
+static set<ResultCache*> registry;
+
+}
+
+class ResultCache::Private
+{
+public:
+    QString name;
+    size_t max_items;
+
+    mutable mutex mutex_;
+    atomic<uint64_t> generation = 0;
+
+    // Most recently used first
+    list<pair<QString, vector<RankItem>>> entries;
+    QHash<QString, decltype(entries)::iterator> lookup;
+    Stats stats;
+
+    void evict(size_t limit)
+    {
+        while (stats.items > limit && !entries.empty())
+        {
+            stats.items -= entries.back().second.size();
+            lookup.remove(entries.back().first);
+            entries.pop_back();
+            ++stats.evictions;
+        }
+        stats.entries = entries.size();
+    }
+};
+
+double ResultCache::Stats::hitRate() const
+{ return hits + misses ? (double)hits / (double)(hits + misses) : 0.; }
+
+ResultCache::ResultCache(const QString &name, size_t max_items) : d(make_unique<Private>())
+{
+    d->name = name;
+    d->max_items = max_items;
+
+    unique_lock lock(registry_mutex);
+    registry.insert(this);
+}
+
+ResultCache::~ResultCache()
+{
+    unique_lock lock(registry_mutex);
+    registry.erase(this);
+}
+
+uint64_t ResultCache::generation() const { return d->generation; }
+
+void ResultCache::invalidate()
+{
+    unique_lock lock(d->mutex_);
+    ++d->generation;
+    d->entries.clear();
+    d->lookup.clear();
+    d->stats.entries = 0;
+    d->stats.items = 0;
+}
+
+optional<vector<RankItem>> ResultCache::get(const QString &key)
+{
+    unique_lock lock(d->mutex_);
+
+    if (auto it = d->lookup.find(key); it != d->lookup.end())
+    {
+        d->entries.splice(d->entries.begin(), d->entries, *it);
+        ++d->stats.hits;
+        return d->entries.front().second;
+    }
+
+    ++d->stats.misses;
+    return nullopt;
+}
+
+void ResultCache::put(const QString &key, uint64_t generation, vector<RankItem> results)
+{
+    if (results.size() > d->max_items)
+        return;
+
+    unique_lock lock(d->mutex_);
+
+    // Computed on outdated data
+    if (generation != d->generation)
+        return;
+
+    if (auto it = d->lookup.find(key); it != d->lookup.end())
+    {
+        d->stats.items -= (*it)->second.size();
+        d->entries.erase(*it);
+        d->lookup.erase(it);
+    }
+
+    d->stats.items += results.size();
+    d->entries.emplace_front(key, ::move(results));
+    d->lookup.insert(key, d->entries.begin());
+    d->evict(d->max_items);
+}
+
+void ResultCache::trim(size_t max_items)
+{
+    unique_lock lock(d->mutex_);
+    d->evict(max_items);
+}
+
+ResultCache::Stats ResultCache::stats() const
+{
+    unique_lock lock(d->mutex_);
+    return d->stats;
+}
+
+QStringList ResultCache::report()
+{
+    unique_lock lock(registry_mutex);
+
+    QStringList sl;
+    sl << QStringLiteral("%1│%2│%3│%4│%5│%6")
+              .arg(QStringLiteral("Cache"), -24)
+              .arg(QStringLiteral("Hit rate"), 9)
+              .arg(QStringLiteral("Hits"), 8)
+              .arg(QStringLiteral("Misses"), 8)
+              .arg(QStringLiteral("Entries"), 8)
+              .arg(QStringLiteral("Items"), 8);
+
+    for (const auto *cache : registry)
+    {
+        auto s = cache->stats();
+        sl << QStringLiteral("%1│%2│%3│%4│%5│%6")
+                  .arg(cache->d->name, -24)
+                  .arg(QString::number(s.hitRate() * 100., 'f', 1) + u'%', 9)
+                  .arg(s.hits, 8)
+                  .arg(s.misses, 8)
+                  .arg(s.entries, 8)
+                  .arg(s.items, 8);
+    }
+
+    return sl;
+}
+
+size_t ResultCache::trimAll(size_t max_items)
+{
+    unique_lock lock(registry_mutex);
+    size_t retained = 0;
+    for (auto *cache : registry)
+    {
+        cache->trim(max_items);
+        retained += cache->stats().items;
+    }
+    return retained;
+}
@@ -0,0 +1,318 @@
+// Copyright (c) 2024 Manuel Schneider
+
+#include "queryexecution.h"
+#include "simulation.h"
+#include "standarditem.h"
+#include <QAbstractItemModel>
+#include <QtGlobal>
+using namespace albert;
+using namespace std::chrono;
+using namespace std;
+
+// Nonzero, default constructed time points mean unset stages
+static const QueryLatency::TimePoint epoch = QueryLatency::TimePoint{} + hours(1);
+
+struct SimulatedExecutor::Fiber
+{
+    Task task;
+    thread worker;
+    bool finished = false;
+};
+
+thread_local SimulatedExecutor::Fiber *SimulatedExecutor::current_ = nullptr;
+
+SimulatedExecutor::SimulatedExecutor(uint workers):
+    active_(nullptr),
+    now_(0),
+    seq_(0),
+    idle_workers_(max(workers, 1u)),
+    executed_(0),
+    cancelled_(0)
+{
+    QueryExecutor::setInstance(this);
+}
+
+SimulatedExecutor::~SimulatedExecutor()
+{
+    runUntilIdle();
+    if (!fibers_.empty())
+        qFatal("Simulation deadlocked. %zu workers blocked.", fibers_.size());
+    QueryExecutor::setInstance(nullptr);
+}
+
+QueryLatency::TimePoint SimulatedExecutor::now() const
+{
+    unique_lock lock(mutex_);
+    return epoch + milliseconds(now_);
+}
+
+QueryExecutor::TaskId SimulatedExecutor::run(Task task, int priority)
+{
+    unique_lock lock(mutex_);
+    const auto id = seq_++;
+    pending_.emplace(make_pair(-priority, id), ::move(task));
+    return id;
+}
+
+bool SimulatedExecutor::cancel(TaskId id)
+{
+    unique_lock lock(mutex_);
+    for (auto it = pending_.begin(); it != pending_.end(); ++it)
+        if (it->first.second == id)
+        {
+            pending_.erase(it);
+            ++cancelled_;
+            return true;
+        }
+    return false;
+}
+
+void SimulatedExecutor::post(QObject *context, Task task)
+{
+    unique_lock lock(mutex_);
+    schedule(now_, {[c = QPointer<QObject>(context), t = ::move(task)]{ if (c) t(); }});
+}
+
+void SimulatedExecutor::wait(QFuture<void> &future)
+{
+    Q_ASSERT(!current_);
+    while (!future.isFinished())
+        if (!step())
+            qFatal("Simulation deadlocked. Waiting for a task that never finishes.");
+}
+
+int SimulatedExecutor::elapsed() const
+{
+    unique_lock lock(mutex_);
+    return now_;
+}
+
+void SimulatedExecutor::sleep(int ms)
+{
+    auto *fiber = current_;
+    Q_ASSERT(fiber);
+
+    unique_lock lock(mutex_);
+    schedule(now_ + ms, {{}, fiber});
+    yield(lock, fiber);
+}
+
+void SimulatedExecutor::at(int ms, Task task)
+{
+    unique_lock lock(mutex_);
+    schedule(ms, {::move(task)});
+}
+
+void SimulatedExecutor::runUntilIdle()
+{
+    while (step());
+}
+
+uint SimulatedExecutor::executedTasks() const
+{
+    unique_lock lock(mutex_);
+    return executed_;
+}
+
+uint SimulatedExecutor::cancelledTasks() const
+{
+    unique_lock lock(mutex_);
+    return cancelled_;
+}
+
+bool SimulatedExecutor::step()
+{
+    unique_lock lock(mutex_);
+
+    // Idle workers pick up pending tasks immediately
+    if (idle_workers_ > 0 && !pending_.empty())
+    {
+        auto node = pending_.extract(pending_.begin());
+        --idle_workers_;
+        auto *fiber = fibers_.emplace_back(make_unique<Fiber>()).get();
+        fiber->task = ::move(node.mapped());
+        fiber->worker = thread(&SimulatedExecutor::threadMain, this, fiber);
+        resume(lock, fiber);
+    }
+    else if (!events_.empty())
+    {
+        auto node = events_.extract(events_.begin());
+        now_ = max(now_, node.key().first);
+        if (auto *fiber = node.mapped().fiber; fiber)
+            resume(lock, fiber);
+        else
+        {
+            lock.unlock();
+            node.mapped().task();
+            return true;
+        }
+    }
+    else
+        return false;
+
+    // Join the workers that returned
+    for (auto it = fibers_.begin(); it != fibers_.end();)
+        if ((*it)->finished)
+        {
+            (*it)->worker.join();
+            it = fibers_.erase(it);
+        }
+        else
+            ++it;
+
+    return true;
+}
+
+void SimulatedExecutor::threadMain(Fiber *fiber)
+{
+    current_ = fiber;
+    {
+        unique_lock lock(mutex_);
+        cv_.wait(lock, [&]{ return active_ == fiber; });
+    }
+
+    fiber->task();
+
+    unique_lock lock(mutex_);
+    ++executed_;
+    ++idle_workers_;
+    fiber->finished = true;
+    active_ = nullptr;
+    cv_.notify_all();
+}
+
+void SimulatedExecutor::resume(unique_lock<mutex> &lock, Fiber *fiber)
+{
+    active_ = fiber;
+    cv_.notify_all();
+    cv_.wait(lock, [&]{ return active_ == nullptr; });
+}
+
+void SimulatedExecutor::yield(unique_lock<mutex> &lock, Fiber *fiber)
+{
+    active_ = nullptr;
+    cv_.notify_all();
+    cv_.wait(lock, [&]{ return active_ == fiber; });
+}
+
+void SimulatedExecutor::schedule(int time, Event event)
+{ events_.emplace(make_pair(time, seq_++), ::move(event)); }
+
+// ////////////////////////////////////////////////////////////////////////////
+
+MockHandler::MockHandler(SimulatedExecutor &executor, QString id, int latency,
+                         QStringList items, int slice):
+    executor_(executor),
+    id_(::move(id)),
+    latency_(latency),
+    slice_(max(slice, 1)),
+    items_(::move(items))
+{}
+
+QString MockHandler::id() const { return id_; }
+
+QString MockHandler::name() const { return id_; }
+
+QString MockHandler::description() const { return id_; }
+
+vector<RankItem> MockHandler::handleGlobalQuery(const Query *query)
+{
+    const int start = executor_.elapsed();
+
+    for (int t = 0; t < latency_ && query->isValid(); t += slice_)
+        executor_.sleep(min(slice_, latency_ - t));
+
+    vector<RankItem> results;
+    if (query->isValid())
+        for (const auto &item : items_)
+            if (item.startsWith(query->string()))
+                results.emplace_back(make_shared<StandardItem>(item, item), 1.);
+
+    unique_lock lock(mutex_);
+    invocations_.push_back({query->string(), start, executor_.elapsed(), query->isValid()});
+    return results;
+}
+
+vector<MockHandler::Invocation> MockHandler::invocations() const
+{
+    unique_lock lock(mutex_);
+    return invocations_;
+}
+
+int MockHandler::wastedTime() const
+{
+    unique_lock lock(mutex_);
+    int wasted = 0;
+    for (const auto &i : invocations_)
+        if (!i.valid)
+            wasted += i.end - i.start;
+    return wasted;
+}
+
+// ////////////////////////////////////////////////////////////////////////////
+
+MockStreamingHandler::MockStreamingHandler(SimulatedExecutor &executor, QString id,
+                                           int interval, int count):
+    executor_(executor),
+    id_(::move(id)),
+    interval_(interval),
+    count_(count)
+{}
+
+QString MockStreamingHandler::id() const { return id_; }
+
+QString MockStreamingHandler::name() const { return id_; }
+
+QString MockStreamingHandler::description() const { return id_; }
+
+void MockStreamingHandler::handleTriggerQuery(Query *query)
+{
+    for (int i = 0; i < count_ && query->isValid(); ++i)
+    {
+        executor_.sleep(interval_);
+        auto s = QString("%1 %2").arg(query->string()).arg(i);
+        query->add(make_shared<StandardItem>(s, s));
+    }
+}
+
+// ////////////////////////////////////////////////////////////////////////////
+
+SimulatedSession::SimulatedSession(SimulatedExecutor &executor, QueryFactory factory):
+    executor_(executor),
+    factory_(::move(factory))
+{}
+
+SimulatedSession::~SimulatedSession() = default;
+
+void SimulatedSession::type(int ms, const QString &input)
+{ executor_.at(ms, [this, input]{ onInput(input); }); }
+
+const vector<SimulatedSession::Frame> &SimulatedSession::frames() const { return frames_; }
+
+int SimulatedSession::finished(const QString &input) const
+{
+    auto it = finished_.find(input);
+    return it == finished_.end() ? -1 : it->second;
+}
+
+void SimulatedSession::onInput(const QString &input)
+{
+    if (!queries_.empty())
+        queries_.back()->cancel();
+
+    auto *q = queries_.emplace_back(factory_(input)).get();
+
+    QObject::connect(q->matches(), &QAbstractItemModel::rowsInserted, q, [this, q, input]{
+        if (queries_.back().get() == q)
+            frames_.push_back({executor_.elapsed(), input, q->matches()->rowCount()});
+    });
+
+    QObject::connect(q, &Query::finished, q, [this, input]{
+        finished_[input] = executor_.elapsed();
+    });
+
+    // The frontend displays the empty model of the new query
+    frames_.push_back({executor_.elapsed(), input, 0});
+
+    q->run();
+}
@@ -0,0 +1,200 @@
+// Copyright (c) 2024 Manuel Schneider
+
+#pragma once
+#include "globalqueryhandler.h"
+#include "queryexecutor.h"
+#include "triggerqueryhandler.h"
+#include <QPointer>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+class QueryExecution;
+
+///
+/// Deterministic query executor on a virtual clock.
+///
+/// Worker tasks run on real threads, but strictly one at a time, handing
+/// control back and forth with the scheduler in the main thread. Work takes
+/// virtual time only if it calls sleep(). Events at the same virtual time run
+/// in the order they have been scheduled. Hence a simulation has exactly one
+/// interleaving and its timings are exact.
+///
+/// Installs itself as query executor for its lifetime.
+///
+class SimulatedExecutor : public QueryExecutor
+{
+public:
+
+    SimulatedExecutor(uint workers = 4);
+    ~SimulatedExecutor();
+
+    QueryLatency::TimePoint now() const override;
+    TaskId run(Task task, int priority) override;
+    bool cancel(TaskId task) override;
+    void post(QObject *context, Task task) override;
+    void wait(QFuture<void> &future) override;
+
+    /// Virtual milliseconds since construction.
+    int elapsed() const;
+
+    /// Takes ms of virtual time. Call it in worker tasks only.
+    void sleep(int ms);
+
+    /// Calls task in the main thread at virtual time ms.
+    void at(int ms, Task task);
+
+    /// Runs the simulation until there is nothing left to do.
+    void runUntilIdle();
+
+    /// The number of worker tasks executed so far.
+    uint executedTasks() const;
+
+    /// The number of worker tasks removed before they started.
+    uint cancelledTasks() const;
+
+private:
+
+    struct Fiber;
+
+    struct Event
+    {
+        Task task;                // Main thread task, or
+        Fiber *fiber = nullptr;   // worker to resume
+    };
+
+    bool step();
+    void threadMain(Fiber *fiber);
+    void resume(std::unique_lock<std::mutex> &lock, Fiber *fiber);
+    void yield(std::unique_lock<std::mutex> &lock, Fiber *fiber);
+    void schedule(int time, Event event);
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    Fiber *active_;  // nullptr if the scheduler runs
+    int now_;
+    uint64_t seq_;
+    uint idle_workers_;
+    uint executed_;
+    uint cancelled_;
+    std::map<std::pair<int, uint64_t>, Event> events_;  // (time, seq)
+    std::map<std::pair<int, TaskId>, Task> pending_;  // (-priority, id)
+    std::vector<std::unique_ptr<Fiber>> fibers_;
+    static thread_local Fiber *current_;
+
+};
+
+
+///
+/// Global query handler taking a configured virtual time per query.
+///
+/// Returns the items starting with the query string. Checks for cancellation
+/// every slice, as well behaved handlers do.
+///
+class MockHandler : public albert::GlobalQueryHandler
+{
+public:
+
+    MockHandler(SimulatedExecutor &executor, QString id, int latency,
+                QStringList items, int slice = 10);
+
+    QString id() const override;
+    QString name() const override;
+    QString description() const override;
+    std::vector<albert::RankItem> handleGlobalQuery(const albert::Query*) override;
+
+    struct Invocation
+    {
+        QString query;
+        int start;
+        int end;
+        bool valid;  ///< Query still valid when the handler returned
+    };
+
+    std::vector<Invocation> invocations() const;
+
+    /// Virtual time spent on queries that have been cancelled.
+    int wastedTime() const;
+
+private:
+
+    SimulatedExecutor &executor_;
+    const QString id_;
+    const int latency_;
+    const int slice_;
+    const QStringList items_;
+    mutable std::mutex mutex_;
+    std::vector<Invocation> invocations_;
+
+};
+
+
+///
+/// Trigger query handler streaming an item per interval of virtual time.
+///
+class MockStreamingHandler : public albert::TriggerQueryHandler
+{
+public:
+
+    MockStreamingHandler(SimulatedExecutor &executor, QString id, int interval, int count);
+
+    QString id() const override;
+    QString name() const override;
+    QString description() const override;
+    void handleTriggerQuery(albert::Query*) override;
+
+private:
+
+    SimulatedExecutor &executor_;
+    const QString id_;
+    const int interval_;
+    const int count_;
+
+};
+
+
+///
+/// Plays session and frontend in a simulation.
+///
+/// Runs a query per input, cancelling the previous one, and records what the
+/// user saw and when.
+///
+class SimulatedSession
+{
+public:
+
+    using QueryFactory = std::function<std::unique_ptr<QueryExecution>(const QString&)>;
+
+    SimulatedSession(SimulatedExecutor &executor, QueryFactory factory);
+    ~SimulatedSession();
+
+    /// Schedules the input at virtual time ms.
+    void type(int ms, const QString &input);
+
+    struct Frame
+    {
+        int time;       ///< Virtual time of the update
+        QString input;  ///< Input of the displayed query
+        int rows;       ///< Displayed rows
+
+        bool operator==(const Frame&) const = default;
+    };
+
+    /// The updates of the displayed results.
+    const std::vector<Frame> &frames() const;
+
+    /// The virtual time the query of input finished or -1.
+    int finished(const QString &input) const;
+
+private:
+
+    void onInput(const QString &input);
+
+    SimulatedExecutor &executor_;
+    QueryFactory factory_;
+    std::vector<std::unique_ptr<QueryExecution>> queries_;
+    std::vector<Frame> frames_;
+    std::map<QString, int> finished_;
+
+};
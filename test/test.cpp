@@ -1,15 +1,35 @@
 // Copyright (c) 2024 Manuel Schneider
 
+#include "datachanges.h"
+#include "diskindex.h"
+#include "diskindexqueryhandler.h"
+#include "federatedindex.h"
+#include "frontend.h"
+#include "indexqueryhandler.h"
+#include "inputhistory.h"
 #include "itemindex.h"
 #include "levenshtein.h"
 #include "matcher.h"
+#include "queryexecution.h"
+#include "querylatency.h"
 #include "rankitem.h"
+#include "resultcache.h"
+#include "simulation.h"
 #include "standarditem.h"
 #include "test.h"
 #include "topologicalsort.hpp"
+#include "usagedatabase.h"
+#include "util.h"
+#include <QScopeGuard>
+#include <QSignalSpy>
+#include <QTemporaryDir>
+#include <QThreadPool>
 #include <chrono>
+#include <condition_variable>
 #include <iostream>
+#include <mutex>
 #include <set>
+#include <thread>
 #include <unistd.h>
 using namespace albert;
 using namespace std::chrono;
@@ -17,6 +37,22 @@ using namespace std;
 
 QTEST_APPLESS_MAIN(AlbertTests)
 
+using Frame = SimulatedSession::Frame;
+
+// Sets an environment variable until the guard goes out of scope
+static auto setEnvironmentVariable(const char *name, const QByteArray &value)
+{
+    const bool was_set = qEnvironmentVariableIsSet(name);
+    const auto previous = qgetenv(name);
+    qputenv(name, value);
+    return qScopeGuard([=]{
+        if (was_set)
+            qputenv(name, previous);
+        else
+            qunsetenv(name);
+    });
+}
+
 void AlbertTests::topological_sort_linear()
 {
     auto result = topologicalSort(map<int, set<int>>{{1, {2}}, {2, {3}}, {3, {}}});
@@ -278,7 +314,8 @@ void AlbertTests::matcher_score()
 
 static auto indexMatch(const QStringList &item_strings,
                        const QString &search_string,
-                       const MatchConfig &config = {})
+                       const MatchConfig &config = {},
+                       uint limit = 0)
 {
     ItemIndex index(config);
 
@@ -288,7 +325,7 @@ static auto indexMatch(const QStringList &item_strings,
 
     index.setItems(::move(index_items));
 
-    return index.search(search_string, true);
+    return index.search(search_string, true, limit);
 };
 
 void AlbertTests::index_empty()
@@ -356,6 +393,37 @@ void AlbertTests::index_fuzzy()
     QVERIFY(indexMatch(abc, "abc_e_g_", c).size() == 0);
 }
 
+void AlbertTests::index_fuzzy_ngram_size()
+{
+    const QStringList strings{"abcdefghijklmnopqrstuvwxyz", "abc", "xbcdefgh", "defghijk"};
+    const QStringList queries{"a", "ab", "abcd", "abc_", "ab__", "abcdefgh", "abcdefg_",
+                              "abcde_g_", "abc_e_g_", "bcdefgh", "xbcd_fgh", "defghi_k"};
+    const MatchConfig c = {.fuzzy = true};
+
+    auto search = [&](uint q, const QString &query)
+    {
+        ItemIndex index(c, q);
+        vector<IndexItem> index_items;
+        for (auto &string : strings)
+            index_items.emplace_back(make_shared<StandardItem>(string), string);
+        index.setItems(::move(index_items));
+
+        QStringList ids;
+        for (const auto &rank_item : index.search(query, true))
+            ids << QString("%1:%2").arg(rank_item.item->id()).arg(rank_item.score);
+        ids.sort();
+        return ids;
+    };
+
+    // Filters must not change the results
+    for (const auto &query : queries)
+        for (uint q : {1u, 3u, 4u})
+            QCOMPARE(search(q, query), search(2, query));
+
+    // Shares no 4-gram with "xbcdefgh" but is within one edit
+    QVERIFY(search(4, "abcd").contains(QString("xbcdefgh:%1").arg(3./4.)));
+}
+
 void AlbertTests::index_case()
 {
     auto m = indexMatch({"a","A"}, "a", {});
@@ -384,6 +452,675 @@ void AlbertTests::index_score()
     QVERIFY(qFuzzyCompare(m[1].score, 3./4.));
 }
 
+void AlbertTests::index_any_word()
+{
+    MatchConfig c = {.match_any_word = true};
+
+    QVERIFY(indexMatch(abc_perm, "a x").size() == 0);
+    QVERIFY(indexMatch(abc_perm, "a x", c).size() == 6);
+    QVERIFY(indexMatch({"ab", "cd", "ef"}, "ab cd x", c).size() == 2);
+
+    auto m = indexMatch({"ab cd", "ab", "abcd", "x"}, "ab cd", c);
+    QVERIFY(m.size() == 3);
+    sort(m.begin(), m.end(), [](auto &a, auto &b){ return a.item->id() < b.item->id(); });
+    QVERIFY(qFuzzyCompare(m[0].score, 1.0));
+    QVERIFY(qFuzzyCompare(m[1].score, 1.0));
+    QVERIFY(qFuzzyCompare(m[2].score, 2.0/4.0));
+
+    // A typo does not discard the other words
+    c.fuzzy = true;
+    QVERIFY(indexMatch({"firefox browser"}, "firefox brxqzr", c).size() == 1);
+}
+
+void AlbertTests::index_any_word_limit()
+{
+    QStringList strings;
+    for (int i = 1; i <= 100; ++i)
+        strings << QString("a %1").arg(QString(i, 'b'));
+
+    MatchConfig c = {.match_any_word = true};
+    auto all = indexMatch(strings, "a b", c);
+    auto top = indexMatch(strings, "a b", c, 10);
+
+    QCOMPARE(all.size(), size_t(100));
+    QCOMPARE(top.size(), size_t(10));
+
+    // The top results are the shortest strings
+    sort(all.begin(), all.end(), [](auto &a, auto &b){ return a.score > b.score; });
+    sort(top.begin(), top.end(), [](auto &a, auto &b){ return a.score > b.score; });
+    for (size_t i = 0; i < top.size(); ++i)
+        QVERIFY(qFuzzyCompare(top[i].score, all[i].score));
+    QCOMPARE(top[0].item->id(), QString("a b"));
+
+    // Limit applies to conjunctive queries too
+    QCOMPARE(indexMatch(strings, "a b", {}, 10).size(), size_t(10));
+}
+
+void AlbertTests::matcher_any_word()
+{
+    MatchConfig c = {.match_any_word = true};
+
+    QVERIFY(!Matcher("a x").match("a b"));
+    QVERIFY(Matcher("a x", c).match("a b"));
+    QVERIFY(!Matcher("x y", c).match("a b"));
+    QCOMPARE(Matcher("ab cd", c).match("ab ef").score(), 2.0/4.0);
+}
+
+class TestIndexHandler : public IndexQueryHandler
+{
+public:
+    TestIndexHandler(QString id, QStringList strings) : id_(id), strings_(strings) {}
+    QString id() const override { return id_; }
+    QString name() const override { return id_; }
+    QString description() const override { return id_; }
+    void updateIndexItems() override
+    {
+        vector<IndexItem> index_items;
+        for (auto &string : strings_)
+            index_items.emplace_back(make_shared<StandardItem>(string, string), string);
+        setIndexItems(::move(index_items));
+    }
+    QString id_;
+    QStringList strings_;
+};
+
+void AlbertTests::federated_index()
+{
+    TestIndexHandler a("a", {"apple", "avocado"});
+    TestIndexHandler b("b", {"apricot", "banana"});
+    GlobalQueryHandler *ha = &a, *hb = &b;
+    auto &index = FederatedIndex::instance(false);
+
+    for (auto *h : {&a, &b})
+    {
+        h->setFuzzyMatching(false);
+        h->setFederated(true);
+    }
+    QVERIFY(index.contains(ha) && index.contains(hb));
+
+    // Results are attributed to their contributors
+    auto results = index.match("ap", true);
+    QCOMPARE(results.matches.size(), size_t(2));
+    for (const auto &[slot, score] : results.matches)
+        QCOMPARE(results.owner(slot), results.item(slot)->id() == "apple" ? ha : hb);
+
+    QCOMPARE(index.search("ap", true, hb).size(), size_t(1));
+    QCOMPARE(index.search("ban", true, ha).size(), size_t(0));
+
+    // Queries materialize the ranked items
+    {
+        SimulatedExecutor executor;
+        GlobalQuery query(nullptr, {}, {ha, hb}, "a");
+        query.run();
+        executor.runUntilIdle();
+
+        set<QString> texts;
+        auto *model = query.matches();
+        for (int row = 0; row < model->rowCount(); ++row)
+            texts.insert(model->index(row, 0).data((int)ItemRoles::TextRole).toString());
+        QVERIFY(texts == set<QString>({"apple", "apricot", "avocado"}));
+    }
+
+    // Opt out restores the private index. The results drop b before the rebuild.
+    b.setFederated(false);
+    QVERIFY(!index.contains(hb));
+    QCOMPARE(index.match("ap", true).matches.size(), size_t(1));
+    QThreadPool::globalInstance()->waitForDone();
+    QCOMPARE(index.match("ap", true).matches.size(), size_t(1));
+
+    // Handlers matching otherwise are not federated
+    QVERIFY(index.accepts(MatchConfig{}, 2));
+    QVERIFY(!index.accepts(MatchConfig{.match_any_word = true}, 2));
+    QVERIFY(!index.accepts(MatchConfig{}, 3));
+
+    // Concurrent rebuilds are coalesced. The published index has all contributions.
+    vector<unique_ptr<TestIndexHandler>> handlers;
+    for (int i = 0; i < 8; ++i)
+    {
+        auto id = QString("concurrent%1").arg(i);
+        auto &h = handlers.emplace_back(make_unique<TestIndexHandler>(id, QStringList{id}));
+        h->setFederated(true);
+        h->setFuzzyMatching(false);
+    }
+    vector<thread> threads;
+    for (auto &h : handlers)
+        threads.emplace_back([&h]{ h->updateIndexItems(); });
+    for (auto &t : threads)
+        t.join();
+    QCOMPARE(index.match("concurrent", true).matches.size(), handlers.size());
+}
+
+void AlbertTests::index_handler_any_word()
+{
+    QStringList strings;
+    for (int i = 1; i <= 200; ++i)
+        strings << QString("a %1").arg(QString(i, 'b'));
+
+    TestIndexHandler handler("any", strings);
+    GlobalQueryHandler *h = &handler;
+    handler.setFederated(true);
+    handler.setMatchAnyWord(true);
+    handler.setFuzzyMatching(false);
+    QVERIFY(!handler.isFederated());
+    QVERIFY(!FederatedIndex::instance(false).contains(h));
+
+    auto count = [&](const QString &string)
+    {
+        SimulatedExecutor executor;
+        GlobalQuery query(nullptr, {}, {h}, string);
+        query.run();
+        executor.runUntilIdle();
+        return query.matches()->rowCount();
+    };
+
+    // A word without matches does not discard the others. Global queries get the top-k.
+    QCOMPARE(count("a x"), 100);
+
+    handler.setMatchAnyWord(false);
+    QVERIFY(handler.isFederated());
+    QCOMPARE(count("a x"), 0);
+    QCOMPARE(count("a b"), 200);
+}
+
+class DirectIndexHandler : public TestIndexHandler
+{
+public:
+    DirectIndexHandler() : TestIndexHandler("direct", {"apple", "apricot"}) {}
+    bool matchesIndexDirectly() const override { return true; }
+};
+
+class OverridingIndexHandler : public TestIndexHandler
+{
+public:
+    OverridingIndexHandler() : TestIndexHandler("overriding", {"apple", "apricot"}) {}
+    vector<RankItem> handleGlobalQuery(const Query *query) override
+    {
+        auto rank_items = TestIndexHandler::handleGlobalQuery(query);
+        erase_if(rank_items, [](const auto &r){ return r.item->text() == "apple"; });
+        rank_items.emplace_back(make_shared<StandardItem>("extra", "extra"), 1);
+        return rank_items;
+    }
+};
+
+void AlbertTests::index_handler_override()
+{
+    DirectIndexHandler direct;
+    OverridingIndexHandler overriding;
+    direct.setFuzzyMatching(false);
+    overriding.setFuzzyMatching(false);
+
+    auto texts = [](GlobalQueryHandler *h)
+    {
+        SimulatedExecutor executor;
+        GlobalQuery query(nullptr, {}, {h}, "ap");
+        query.run();
+        executor.runUntilIdle();
+
+        set<QString> texts;
+        auto *model = query.matches();
+        for (int row = 0; row < model->rowCount(); ++row)
+            texts.insert(model->index(row, 0).data((int)ItemRoles::TextRole).toString());
+        return texts;
+    };
+
+    // Handlers opting in are matched directly. The results of the others are used unchanged.
+    QVERIFY(texts(&direct) == set<QString>({"apple", "apricot"}));
+    QVERIFY(texts(&overriding) == set<QString>({"apricot", "extra"}));
+}
+
+void AlbertTests::data_changes()
+{
+    QSignalSpy spy(&DataChanges::instance(), &DataChanges::changed);
+    const auto generation = ItemIndex::generation();
+
+    TestIndexHandler handler("tracked", {"a"});
+    handler.setFuzzyMatching(false);
+    QVERIFY(ItemIndex::generation() > generation);
+    QCOMPARE(spy.count(), (qsizetype)(ItemIndex::generation() - generation));
+
+    // Results of index handlers change with the generations only
+    GlobalQuery query(nullptr, {}, {&handler}, "a");
+    QVERIFY(query.isGenerationTracked());
+}
+
+void AlbertTests::index_progressive()
+{
+    QStringList strings;
+    for (int i = 0; i < 20000; ++i)
+        strings << QString("item %1").arg(i);
+
+    // Builds partial indices first. Eventually has all items.
+    TestIndexHandler handler("progressive", strings);
+    handler.setFuzzyMatching(false);
+
+    SimulatedExecutor executor;
+    SimulatedSession session(executor, [&](const QString &input){
+        return make_unique<GlobalQuery>(nullptr, vector<FallbackHandler*>{},
+                                        vector<GlobalQueryHandler*>{&handler}, input);
+    });
+    session.type(0, "item 19999");
+    session.type(10, "item 1999");
+
+    // Rebuilds replace the complete index at once
+    executor.at(5, [&]{
+        handler.strings_.removeLast();
+        handler.updateIndexItems();
+    });
+    executor.runUntilIdle();
+
+    auto expect = vector<Frame>{{0, "item 19999", 0}, {0, "item 19999", 1},
+                                {10, "item 1999", 0}, {10, "item 1999", 10}};
+    QVERIFY(session.frames() == expect);
+}
+
+void AlbertTests::index_progressive_first_snapshot()
+{
+    QTemporaryDir dir;
+    auto config_home = setEnvironmentVariable("XDG_CONFIG_HOME", dir.filePath("config").toLocal8Bit());
+    auto data_home = setEnvironmentVariable("XDG_DATA_HOME", dir.filePath("data").toLocal8Bit());
+    QVERIFY(QDir().mkpath(configLocation()));
+    QVERIFY(QDir().mkpath(dataLocation()));
+    UsageHistory::initialize();
+    UsageHistory::addActivation("item", "progressive", "item 19999", "action");
+    UsageHistory::addActivation("item", "progressive", "item 15000", "action");
+
+    QStringList strings;
+    for (int i = 0; i < 20000; ++i)
+        strings << QString("item %1").arg(i);
+    TestIndexHandler handler("progressive", strings);
+
+    // Blocks the build once the second partial index is built, i.e. the first is published
+    mutex m;
+    condition_variable cv;
+    int built = 0;
+    bool blocked = false;
+    bool resume = false;
+    auto connection = QObject::connect(&DataChanges::instance(), &DataChanges::changed,
+                                       &DataChanges::instance(), [&]{
+        unique_lock lock(m);
+        if (++built == 2)
+        {
+            blocked = true;
+            cv.notify_all();
+            cv.wait(lock, [&]{ return resume; });
+        }
+    }, Qt::DirectConnection);
+
+    thread build([&]{ handler.setFuzzyMatching(false); });
+    {
+        unique_lock lock(m);
+        cv.wait(lock, [&]{ return blocked; });
+    }
+
+    auto count = [&](const QString &string)
+    {
+        SimulatedExecutor executor;
+        GlobalQuery query(nullptr, {}, {&handler}, string);
+        query.run();
+        executor.runUntilIdle();
+        return query.matches()->rowCount();
+    };
+
+    // The first snapshot has the most used items
+    QCOMPARE(count("item 19999"), 1);
+    QCOMPARE(count("item 15000"), 1);
+    QCOMPARE(count("item 10000"), 0);
+
+    // A build meanwhile continues growing the published snapshot, i.e. builds
+    // the next larger partial index and the complete one
+    const auto generation = ItemIndex::generation();
+    handler.updateIndexItems();
+    QCOMPARE(ItemIndex::generation() - generation, uint64_t(2));
+    QCOMPARE(count("item 10000"), 1);
+
+    {
+        unique_lock lock(m);
+        resume = true;
+    }
+    cv.notify_all();
+    build.join();
+    QObject::disconnect(connection);
+
+    // The superseded build did not publish
+    QCOMPARE(count("item 10000"), 1);
+}
+
+static vector<RankItem> rankItems(const QStringList &ids)
+{
+    vector<RankItem> rank_items;
+    for (const auto &id : ids)
+        rank_items.emplace_back(make_shared<StandardItem>(id), 1.);
+    return rank_items;
+}
+
+void AlbertTests::result_cache()
+{
+    ResultCache cache("test", 4);
+
+    QVERIFY(!cache.get("a"));
+    cache.put("a", cache.generation(), rankItems({"a1", "a2"}));
+    auto results = cache.get("a");
+    QVERIFY(results);
+    QCOMPARE(results->size(), size_t(2));
+    QCOMPARE(results->at(0).item->id(), QString("a1"));
+
+    // Results computed before invalidation are dropped
+    auto generation = cache.generation();
+    cache.invalidate();
+    QVERIFY(!cache.get("a"));
+    cache.put("a", generation, rankItems({"a1"}));
+    QVERIFY(!cache.get("a"));
+
+    auto s = cache.stats();
+    QCOMPARE(s.hits, uint64_t(1));
+    QCOMPARE(s.misses, uint64_t(3));
+    QCOMPARE(s.entries, size_t(0));
+}
+
+void AlbertTests::result_cache_lru()
+{
+    ResultCache cache("test", 4);
+    auto g = cache.generation();
+
+    cache.put("a", g, rankItems({"a1", "a2"}));
+    cache.put("b", g, rankItems({"b1"}));
+    QVERIFY(cache.get("a"));  // a is now more recent than b
+    cache.put("c", g, rankItems({"c1", "c2"}));  // 5 items, evicts b
+
+    QVERIFY(cache.get("a"));
+    QVERIFY(!cache.get("b"));
+    QVERIFY(cache.get("c"));
+    QCOMPARE(cache.stats().items, size_t(4));
+    QCOMPARE(cache.stats().evictions, uint64_t(1));
+
+    // Larger than the cache
+    cache.put("d", g, rankItems({"d1", "d2", "d3", "d4", "d5"}));
+    QVERIFY(!cache.get("d"));
+
+    cache.trim(2);
+    QCOMPARE(cache.stats().entries, size_t(1));
+}
+
+void AlbertTests::disk_index()
+{
+    QTemporaryDir dir;
+    DiskIndex::Builder builder(dir.path(), 2);  // Several shards
+    builder.add("/home/user/Documents/report.pdf", {"report", "/home/user/Documents/report.pdf"});
+    builder.add("/home/user/Music/song.mp3", {"song"});
+    builder.add("/home/user/Documents/Résumé.odt", {"resume"});
+    builder.add("/tmp/report-draft.txt", {"draft"});
+    builder.add("", {"ignored"});
+    QVERIFY(builder.finish());
+
+    DiskIndex index(dir.path());
+    QCOMPARE(index.size(), size_t(4));
+
+    auto fields = [&](const QString &query, uint limit = 0)
+    {
+        QStringList result;
+        for (const auto &match : index.search(query, true, limit))
+            result << index.fields(match).first();
+        result.sort();
+        return result;
+    };
+
+    QCOMPARE(fields("repo"), QStringList({"draft", "report"}));
+    QCOMPARE(fields("documents rep"), QStringList({"report"}));
+    QCOMPARE(fields("resume"), QStringList({"resume"}));
+    QCOMPARE(fields("user"), QStringList({"report", "resume", "song"}));
+    QVERIFY(fields("user", 1).size() == 1);
+    QCOMPARE(fields("nothing"), QStringList());
+    QCOMPARE(fields(""), QStringList());
+
+    auto matches = index.search("report", true, 0);
+    QCOMPARE(matches.size(), size_t(2));
+    QVERIFY(index.fields(matches[0]).size() + index.fields(matches[1]).size() == 3);
+}
+
+class TestDiskIndexHandler : public DiskIndexQueryHandler
+{
+public:
+    QString id() const override { return QStringLiteral("diskindex"); }
+    QString name() const override { return id(); }
+    QString description() const override { return id(); }
+    shared_ptr<Item> createItem(const QStringList &fields) const override
+    { return make_shared<StandardItem>(fields.first(), fields.first()); }
+};
+
+void AlbertTests::disk_index_handler()
+{
+    QTemporaryDir cache;
+    auto cache_home = setEnvironmentVariable("XDG_CACHE_HOME", cache.path().toLocal8Bit());
+    const QDir dir(QString("%1/diskindex/diskindex").arg(cacheLocation()));
+
+    auto search = [](TestDiskIndexHandler &handler, const QString &string)
+    {
+        SimulatedExecutor executor;
+        GlobalQuery query(nullptr, {}, {&handler}, string);
+        query.run();
+        executor.runUntilIdle();
+
+        QStringList ids;
+        auto *model = query.matches();
+        for (int row = 0; row < model->rowCount(); ++row)
+            ids << model->index(row, 0).data((int)ItemRoles::TextRole).toString();
+        return ids;
+    };
+
+    auto generations = [&]
+    {
+        QThreadPool::globalInstance()->waitForDone();  // Removed in the background
+        return dir.entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+    };
+
+    {
+        TestDiskIndexHandler handler;
+        QCOMPARE(search(handler, "apple"), QStringList());
+
+        auto writer = handler.indexWriter();
+        writer.add("apple", {"apple"});
+        QVERIFY(writer.commit());
+        QCOMPARE(search(handler, "app"), QStringList({"apple"}));
+
+        // Commits switch the generation and remove the previous one
+        auto next = handler.indexWriter();
+        next.add("banana", {"banana"});
+        QVERIFY(next.commit());
+        QCOMPARE(search(handler, "app"), QStringList());
+        QCOMPARE(search(handler, "ban"), QStringList({"banana"}));
+        QCOMPARE(generations().size(), 1);
+
+        // Uncommitted entries are discarded
+        handler.indexWriter().add("cherry", {"cherry"});
+        QCOMPARE(generations().size(), 1);
+    }
+
+    // Leftovers of previous sessions are removed on load
+    const auto current = generations().first();
+    QVERIFY(dir.mkpath("0000000000000001-000000"));
+    QVERIFY(dir.mkpath("tmp-0000000000000001-000000"));
+    {
+        TestDiskIndexHandler handler;
+        QCOMPARE(search(handler, "ban"), QStringList({"banana"}));
+        QCOMPARE(generations(), QStringList({current}));
+    }
+
+    // Writers outliving their handler do not commit
+    {
+        auto handler = make_unique<TestDiskIndexHandler>();
+        auto writer = handler->indexWriter();
+        writer.add("cherry", {"cherry"});
+        handler.reset();
+        QVERIFY(!writer.commit());
+    }
+    QCOMPARE(generations(), QStringList({current}));
+}
+
+void AlbertTests::input_history_dedupe()
+{
+    QTemporaryDir dir;
+    InputHistory h(dir.filePath("history"));
+    h.add("a");
+    h.add("b");
+    h.add("a");
+    h.add("");
+
+    QCOMPARE(h.next(), QString("a"));
+    QCOMPARE(h.next(), QString("b"));
+    QCOMPARE(h.next(), QString());
+    QCOMPARE(h.prev(), QString("a"));
+    QCOMPARE(h.prev(), QString());
+}
+
+void AlbertTests::input_history_search()
+{
+    QTemporaryDir dir;
+    InputHistory h(dir.filePath("history"));
+    for (int i = 0; i < 100; ++i)
+        h.add(QString("entry %1").arg(i));
+    h.add("Firefox");
+    h.add("files");
+
+    // Indexed patterns
+    QCOMPARE(h.next("FIRE"), QString("Firefox"));
+    QCOMPARE(h.next("FIRE"), QString());
+    h.resetIterator();
+    QCOMPARE(h.next("ry 9"), QString("entry 99"));
+    QCOMPARE(h.next("ry 9"), QString("entry 98"));
+    QCOMPARE(h.prev("ry 9"), QString("entry 99"));
+    QCOMPARE(h.prev("ry 9"), QString());
+    h.resetIterator();
+    QCOMPARE(h.next("xyz"), QString());
+
+    // Too short to be indexed
+    h.resetIterator();
+    QCOMPARE(h.next("fi"), QString("files"));
+    QCOMPARE(h.next("fi"), QString("Firefox"));
+}
+
+void AlbertTests::input_history_journal()
+{
+    QTemporaryDir dir;
+    auto path = dir.filePath("history");
+
+    {
+        InputHistory h(path);
+        h.add("a");
+        h.add("b");
+        h.add("a");
+
+        // Appended immediately, no clean shutdown needed
+        QFile f(path);
+        QVERIFY(f.open(QIODevice::ReadOnly));
+        QCOMPARE(f.readAll(), QByteArray("a\nb\na\n"));
+    }
+
+    InputHistory h(path);
+    QCOMPARE(h.next(), QString("a"));
+    QCOMPARE(h.next(), QString("b"));
+    QCOMPARE(h.next(), QString());
+}
+
+void AlbertTests::rolling_percentiles()
+{
+    RollingPercentiles p;
+    QCOMPARE(p.percentile(50), 0.);
+
+    for (int i = 100; 0 < i; --i)
+        p.add(i);
+
+    QCOMPARE(p.size(), size_t(100));
+    QCOMPARE(p.percentile(0), 1.);
+    QCOMPARE(p.percentile(50), 50.);
+    QCOMPARE(p.percentile(90), 90.);
+    QCOMPARE(p.percentile(99), 99.);
+    QCOMPARE(p.percentile(100), 100.);
+}
+
+void AlbertTests::rolling_percentiles_window()
+{
+    RollingPercentiles p(10);
+
+    for (int i = 1; i <= 20; ++i)
+        p.add(i);
+
+    QCOMPARE(p.size(), size_t(10));
+    QCOMPARE(p.percentile(0), 11.);
+    QCOMPARE(p.percentile(50), 15.);
+    QCOMPARE(p.percentile(100), 20.);
+}
+
+void AlbertTests::simulation_typing()
+{
+    SimulatedExecutor executor;
+    MockHandler slow(executor, "slow", 100, {"abc", "abd", "xyz"});
+    MockHandler fast(executor, "fast", 50, {"abcde"});
+
+    SimulatedSession session(executor, [&](const QString &input){
+        return make_unique<GlobalQuery>(nullptr, vector<FallbackHandler*>{},
+                                        vector<GlobalQueryHandler*>{&slow, &fast}, input);
+    });
+    session.type(0, "a");
+    session.type(30, "ab");
+    session.type(60, "abc");
+    executor.runUntilIdle();
+
+    // Global results show up once the slowest handler returned
+    auto expect = vector<Frame>{{0, "a", 0}, {30, "ab", 0}, {60, "abc", 0}, {160, "abc", 2}};
+    QVERIFY(session.frames() == expect);
+
+    // Cancelled queries end at the next cancellation check
+    QCOMPARE(session.finished("a"), 30);
+    QCOMPARE(session.finished("ab"), 60);
+    QCOMPARE(session.finished("abc"), 160);
+    QCOMPARE(slow.wastedTime(), 60);
+    QCOMPARE(fast.wastedTime(), 60);
+}
+
+void AlbertTests::simulation_streaming()
+{
+    SimulatedExecutor executor;
+    MockStreamingHandler handler(executor, "stream", 20, 3);
+
+    SimulatedSession session(executor, [&](const QString &input){
+        return make_unique<QueryExecution>(nullptr, vector<FallbackHandler*>{},
+                                           &handler, input, "s ");
+    });
+    session.type(0, "x");
+    executor.runUntilIdle();
+
+    // Trigger query results show up as they arrive
+    auto expect = vector<Frame>{{0, "x", 0}, {20, "x", 1}, {40, "x", 2}, {60, "x", 3}};
+    QVERIFY(session.frames() == expect);
+    QCOMPARE(session.finished("x"), 60);
+}
+
+void AlbertTests::simulation_stale_work()
+{
+    SimulatedExecutor executor(1);
+    MockHandler a(executor, "a", 100, {"ab"});
+    MockHandler b(executor, "b", 100, {"abc"});
+
+    SimulatedSession session(executor, [&](const QString &input){
+        return make_unique<GlobalQuery>(nullptr, vector<FallbackHandler*>{},
+                                        vector<GlobalQueryHandler*>{&a, &b}, input);
+    });
+    session.type(0, "a");
+    session.type(10, "ab");
+    executor.runUntilIdle();
+
+    auto expect = vector<Frame>{{0, "a", 0}, {10, "ab", 0}, {210, "ab", 2}};
+    QVERIFY(session.frames() == expect);
+
+    // The pending task of the stale query got dropped. The new query did not wait.
+    QCOMPARE(executor.executedTasks(), 5u);
+    QCOMPARE(executor.cancelledTasks(), 1u);
+    QCOMPARE(a.invocations().back().start, 10);
+    QCOMPARE(a.invocations().size(), size_t(2));
+    QCOMPARE(b.invocations().size(), size_t(1));
+    QCOMPARE(a.wastedTime() + b.wastedTime(), 10);
+}
+
 
 // // -------------------------------------------------------------------------------------------------
 
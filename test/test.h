@@ -36,8 +36,33 @@ private slots:
     void index_diacritics();
     void index_separators();
     void index_fuzzy();
+    void index_fuzzy_ngram_size();
     void index_case();
     void index_score();
+    void index_any_word();
+    void index_any_word_limit();
+    void matcher_any_word();
+    void federated_index();
+    void index_handler_any_word();
+    void index_handler_override();
+    void data_changes();
+    void index_progressive();
+    void index_progressive_first_snapshot();
+    void result_cache();
+    void result_cache_lru();
+    void disk_index();
+    void disk_index_handler();
+
+    void input_history_dedupe();
+    void input_history_search();
+    void input_history_journal();
+
+    void rolling_percentiles();
+    void rolling_percentiles_window();
+
+    void simulation_typing();
+    void simulation_streaming();
+    void simulation_stale_work();
 
     // void benchmark_comparison_vanilla_vs_fast_levenshtein();
 